@@ -0,0 +1,57 @@
+#ifndef REDISBIGKEYS_H
+#define REDISBIGKEYS_H
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Background scan for the biggest keys of each type (BIGKEYS).
+// A detached thread walks the keyspace SCAN_BUCKETS hash buckets at a time
+// through RedisDatabase::scanKeySizes, so db_mutex is only held for one small
+// step and commands keep being served while millions of keys are measured.
+// The report keeps the top keys by element count and by estimated bytes, each
+// key at most once even when a rehash makes the scan visit it twice.
+class RedisBigKeys {
+public:
+    static const size_t SCAN_BUCKETS = 256;
+    static const size_t SCAN_SAMPLES = 5; // elements measured per container, as MEMORY USAGE
+    static const size_t DEFAULT_TOP = 10;
+    static const size_t MAX_TOP = 1000;
+
+    struct KeySize {
+        std::string key;
+        size_t elements;
+        size_t bytes;
+    };
+
+    static RedisBigKeys& getInstance();
+
+    // false when a scan is already running
+    bool start(size_t top);
+    // INFO style text with the progress and the biggest keys found so far
+    std::string report();
+
+private:
+    RedisBigKeys() = default;
+    ~RedisBigKeys() = default;
+    RedisBigKeys(const RedisBigKeys&) = delete;
+    RedisBigKeys& operator=(const RedisBigKeys&) = delete;
+
+    void run();
+    // report_mutex must be held
+    void consider(const std::string& key, const char* type, size_t elements, size_t bytes);
+
+    std::mutex report_mutex;
+    bool running = false;
+    bool finished = false;
+    size_t top_count = DEFAULT_TOP;
+    uint64_t scanned_keys = 0;
+    size_t restarts = 0; // store walks started over after a rehash
+    std::chrono::steady_clock::time_point started, stopped;
+    std::map<std::string, std::vector<KeySize>> by_elements; // type -> biggest first
+    std::map<std::string, std::vector<KeySize>> by_bytes;
+};
+
+#endif //REDISBIGKEYS_H
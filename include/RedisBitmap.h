@@ -0,0 +1,60 @@
+#ifndef REDISBITMAP_H
+#define REDISBITMAP_H
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Bit operations on string values (SETBIT, BITCOUNT, BITPOS, BITOP, BITFIELD).
+// Bit 0 is the most significant bit of the first byte, as in Redis.
+// The kernels working on whole buffers (popcount, bitwise ops, scanning for
+// the first set / clear bit) have AVX-512 and AVX2 versions picked at
+// runtime from what the CPU supports, and a portable scalar fallback.
+enum BitOp { BITOP_AND, BITOP_OR, BITOP_XOR, BITOP_NOT };
+
+enum BitfieldOverflow { BITFIELD_WRAP, BITFIELD_SAT, BITFIELD_FAIL };
+
+struct BitfieldOp {
+    enum Kind { GET, SET, INCRBY } kind = GET;
+    bool isSigned = false;
+    int bits = 0;        // i1..i64, u1..u63
+    uint64_t offset = 0; // in bits
+    int64_t value = 0;   // SET value / INCRBY increment
+    BitfieldOverflow overflow = BITFIELD_WRAP;
+};
+
+class RedisBitmap {
+public:
+    // strings are capped at 512MB, so bit offsets fit in 32 bits
+    static const uint64_t MAX_BIT_OFFSET = (1ULL << 32) - 1;
+
+    static int getBit(const std::string& value, uint64_t offset);
+    // grows value with zero bytes when needed, returns the previous bit
+    static int setBit(std::string& value, uint64_t offset, int bit);
+
+    // BITCOUNT / BITPOS ranges: start and end are inclusive, in bytes or bits
+    // (bitUnit), negative values count from the end. false when empty.
+    static bool resolveRange(size_t size, long long start, long long end, bool bitUnit,
+                             uint64_t& firstBit, uint64_t& lastBit);
+    // set bits in [firstBit, lastBit]
+    static uint64_t count(const std::string& value, uint64_t firstBit, uint64_t lastBit);
+    // first bit equal to bit in [firstBit, lastBit], -1 if none
+    static long long position(const std::string& value, int bit, uint64_t firstBit, uint64_t lastBit);
+
+    // dest = op over the sources, shorter ones read as zero padded
+    static void bitop(BitOp op, const std::string* const* sources, size_t count, std::string& dest);
+
+    // applies one BITFIELD operation; false when OVERFLOW FAIL skipped it.
+    // result is the value read (GET), the old value (SET) or the new one (INCRBY).
+    static bool bitfield(std::string& value, const BitfieldOp& op, int64_t& result);
+
+private:
+    static uint64_t popcount(const uint8_t* p, size_t size);
+    // index of the first byte different from skip, size if none
+    static size_t findByteNot(const uint8_t* p, size_t size, uint8_t skip);
+    // dest[i] = dest[i] op src[i] (AND / OR / XOR)
+    static void combine(BitOp op, uint8_t* dest, const uint8_t* src, size_t size);
+    static uint64_t getField(const std::string& value, uint64_t offset, int bits);
+    static void setField(std::string& value, uint64_t offset, int bits, uint64_t field);
+};
+
+#endif //REDISBITMAP_H
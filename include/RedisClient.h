@@ -0,0 +1,98 @@
+#ifndef REDISCLIENT_H
+#define REDISCLIENT_H
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <sys/uio.h>
+
+// A reply buffer that can be shared by several clients. PUBLISH encodes a
+// message once and appends the same buffer to every subscriber's queue.
+using RedisReply = std::shared_ptr<const std::string>;
+
+class RedisClient {
+public:
+    explicit RedisClient(int fd);
+    ~RedisClient();
+
+    int fd() const { return socket_fd; }
+    // unique for the lifetime of the process (CLIENT ID)
+    uint64_t id() const { return client_id; }
+    // eventfd used to wake the connection thread when another thread queues output
+    int wakeFd() const { return wake_fd; }
+
+    // queue a reply from the connection's own thread (flushed by the caller);
+    // returns false once the client is closing
+    bool write(const std::string& reply);
+    // queue a reply from another thread and wake the connection thread;
+    // returns false if the client went over its push output limit and was closed
+    bool push(const RedisReply& reply);
+    // push() without the wakeup: needsWake is set when the caller must call
+    // wake(), which lets it signal a batch of clients after dropping its locks
+    bool push(const RedisReply& reply, bool& needsWake);
+    void wake();
+    // send as much of the queue as the socket accepts without blocking
+    bool flush();
+    // fill iov with the queued output without removing it, for backends that
+    // submit the write themselves; consumeOutput drops what was sent
+    int prepareOutput(iovec* iov, int maxIov);
+    void consumeOutput(size_t bytes);
+    bool hasPendingOutput();
+    size_t pendingBytes();
+
+    // shutdown the socket so the connection thread leaves its poll loop
+    void close();
+    bool isClosing() const { return closing; }
+    // set by QUIT: stop reading and close once the pending output is sent
+    bool close_after_reply = false;
+    // cluster: set by ASKING, valid for the next command only
+    bool asking = false;
+    // protocol chosen with HELLO, read by other threads sending invalidations
+    std::atomic<int> resp{2};
+
+    // when set, push() reports the empty -> non-empty transition here instead
+    // of writing to wakeFd (used by the io_uring event loop)
+    std::function<void(RedisClient&)> onPendingOutput;
+
+    // bytes received but not yet parsed into complete commands
+    std::string query_buffer;
+
+    // pub/sub state, guarded by the RedisPubSub mutex
+    std::unordered_set<std::string> channels;
+    std::unordered_set<std::string> patterns;
+    size_t subscriptionCount() const { return channels.size() + patterns.size(); }
+
+    // CLIENT TRACKING state, changed under the RedisTracking mutex
+    bool tracking = false;
+    bool tracking_bcast = false;
+    uint64_t tracking_redirect = 0;
+    std::unordered_set<std::string> tracking_prefixes;
+
+private:
+    RedisClient(const RedisClient&) = delete;
+    RedisClient& operator=(const RedisClient&) = delete;
+
+    // limited: queued by push(), which applies the push output limit;
+    // wasEmpty tells whether this is the first pending reply
+    bool enqueue(RedisReply reply, bool limited, bool& wasEmpty);
+    // both expect out_mutex to be held
+    int fillIov(iovec* iov, int maxIov);
+    void consume(size_t bytes);
+
+    int socket_fd;
+    uint64_t client_id;
+    int wake_fd;
+    std::atomic<bool> closing;
+
+    std::mutex out_mutex;
+    std::deque<RedisReply> out_queue;
+    size_t out_offset; // bytes of out_queue.front() already sent
+    size_t out_bytes;  // bytes queued and not yet sent
+};
+
+#endif //REDISCLIENT_H
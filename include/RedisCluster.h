@@ -0,0 +1,91 @@
+#ifndef REDISCLUSTER_H
+#define REDISCLUSTER_H
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "RedisConnection.h"
+
+// Cluster mode: the keyspace is split in 16384 hash slots, each owned by one
+// node. Nodes learn about each other and about slot ownership by pinging
+// every known node once per second (CLUSTER PING carries the sender's own
+// CLUSTER NODES line, the reply is the receiver's full table). A slot claim
+// is only accepted from the claiming node itself and wins over the current
+// owner when its config epoch is higher.
+class RedisCluster {
+public:
+    static const int CLUSTER_SLOTS = 16384;
+    static const int CLUSTER_GOSSIP_INTERVAL_MS = 1000;
+    static const int CLUSTER_LINK_TIMEOUT_MS = 500;
+
+    static RedisCluster& getInstance();
+
+    // CRC16 (XMODEM) of the key, or of the first non-empty {hashtag}, mod 16384
+    static uint16_t crc16(const char* buf, size_t len);
+    static int keyHashSlot(const std::string& key);
+
+    void enable(int port, const std::string& announceHost);
+    bool isEnabled() const { return enabled; }
+
+    // empty when a command on keys can run on this node, otherwise the
+    // -CROSSSLOT / -CLUSTERDOWN / -MOVED / -ASK reply
+    std::string route(const std::vector<std::string>& keys, bool asking);
+
+    // CLUSTER subcommands, tokens[0] is "CLUSTER"; returns the RESP reply
+    std::string command(const std::vector<std::string>& tokens);
+
+    // MIGRATE: copy keys to host:port with pipelined RESTORE-ASKING and
+    // delete them here unless copy is set; returns the RESP reply
+    static std::string migrate(const std::string& host, int port, const std::vector<std::string>& keys,
+                               int timeoutMs, bool copy, bool replace);
+
+private:
+    RedisCluster();
+    ~RedisCluster();
+    RedisCluster(const RedisCluster&) = delete;
+    RedisCluster& operator=(const RedisCluster&) = delete;
+
+    struct Node {
+        std::string id;
+        std::string host;
+        int port = 0;
+        uint64_t configEpoch = 0;
+        bool connected = false;
+    };
+
+    // cluster_mutex must be held by the helpers below
+    std::string nodeLine(const Node& node);
+    std::string nodesText();
+    // learn a node from a CLUSTER NODES line; fromSelf: the line was sent by
+    // that node itself, so its slot claims are authoritative
+    void applyNodeLine(const std::string& line, bool fromSelf);
+    void applyNodesText(const std::string& text);
+    void bumpEpoch();
+    // [start, end, owner] for every contiguous range of assigned slots
+    std::vector<std::pair<std::pair<int, int>, std::string>> slotRanges();
+
+    std::string setSlot(const std::vector<std::string>& tokens);
+    std::string meet(const std::string& host, int port);
+    void gossip();
+
+    std::mutex cluster_mutex;
+    bool enabled;
+    std::string my_id;
+    uint64_t current_epoch;
+    std::unordered_map<std::string, Node> nodes; // includes this node
+    std::vector<std::string> slot_owner;         // node id, empty when unassigned
+    std::unordered_map<int, std::string> migrating; // slot -> target node id
+    std::unordered_map<int, std::string> importing; // slot -> source node id
+
+    // links are only used by the gossip thread
+    std::unordered_map<std::string, std::unique_ptr<RedisConnection>> links;
+    std::atomic<bool> stopping;
+    std::thread gossip_thread;
+};
+
+#endif //REDISCLUSTER_H
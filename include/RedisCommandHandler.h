@@ -2,12 +2,17 @@
 #define REDISCOMMANDHANDLER_H
 #include <string>
 
+#include "RedisClient.h"
+
 class RedisCommandHandler {
 
 public:
     RedisCommandHandler();
     // process command from the client and return RESP (Redis Protocol)-formatted response
-    std::string processCommand(const std::string& commandLine);
+    std::string processCommand(const std::string& commandLine, RedisClient& client);
+    // run every complete command in client.query_buffer (pipelining), leaving
+    // a trailing partial command in place; returns the concatenated replies
+    std::string processBuffer(RedisClient& client);
 };
 
 #endif //REDISCOMMANDHANDLER_H
@@ -0,0 +1,43 @@
+#ifndef REDISCOMPRESSION_H
+#define REDISCOMPRESSION_H
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+// Value compression (--value-compression-threshold).
+// The codec is LZF style: literal runs of up to 32 bytes and back references
+// of up to 264 bytes into the last 8KB, found through a hash of the next
+// three bytes. It favours speed over ratio, which suits the text and JSON
+// blobs it is meant for. Also keeps the INFO memory counters of the values
+// currently stored compressed (see RedisString).
+class RedisCompression {
+public:
+    static RedisCompression& getInstance();
+
+    // values of at least bytes are compressed when stored, 0 disables it
+    void setThreshold(size_t bytes) { min_size = bytes; }
+    size_t threshold() const { return min_size; }
+
+    // false when the input does not fit in maxSize bytes once compressed
+    static bool compress(const char* in, size_t size, std::string& out, size_t maxSize);
+    // false on corrupt input; out receives rawSize bytes
+    static bool decompress(const char* in, size_t size, std::string& out, size_t rawSize);
+
+    void account(long long values, long long compressedBytes, long long rawBytes);
+    long long compressedValues() const { return compressed_values; }
+    long long compressedBytes() const { return compressed_bytes; }
+    long long rawBytes() const { return raw_bytes; }
+
+private:
+    RedisCompression() = default;
+    ~RedisCompression() = default;
+    RedisCompression(const RedisCompression&) = delete;
+    RedisCompression& operator=(const RedisCompression&) = delete;
+
+    std::atomic<size_t> min_size{0};
+    std::atomic<long long> compressed_values{0};
+    std::atomic<long long> compressed_bytes{0};
+    std::atomic<long long> raw_bytes{0};
+};
+
+#endif //REDISCOMPRESSION_H
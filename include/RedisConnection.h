@@ -0,0 +1,46 @@
+#ifndef REDISCONNECTION_H
+#define REDISCONNECTION_H
+#include <string>
+#include <vector>
+
+// parsed RESP reply read by RedisConnection
+struct RedisConnectionReply {
+    char type = 0;          // '+', '-', ':', '$' or '*'
+    std::string str;        // status, error or bulk payload
+    long long integer = 0;
+    bool nil = false;       // $-1 / *-1
+    std::vector<RedisConnectionReply> elements;
+};
+
+// Blocking client connection to another server (cluster links, MIGRATE).
+class RedisConnection {
+public:
+    RedisConnection();
+    ~RedisConnection();
+
+    bool connect(const std::string& host, int port, int timeoutMs);
+    bool isConnected() const { return fd != -1; }
+    void close();
+
+    // commands are buffered by append and sent by the first readReply, so a
+    // batch of commands costs a single write
+    void append(const std::vector<std::string>& args);
+    bool readReply(RedisConnectionReply& reply);
+    bool command(const std::vector<std::string>& args, RedisConnectionReply& reply);
+
+private:
+    RedisConnection(const RedisConnection&) = delete;
+    RedisConnection& operator=(const RedisConnection&) = delete;
+
+    bool flush();
+    bool readLine(std::string& line);
+    bool readBytes(size_t count, std::string& out);
+    bool fill();
+
+    int fd;
+    std::string out;
+    std::string in;
+    size_t in_pos;
+};
+
+#endif //REDISCONNECTION_H
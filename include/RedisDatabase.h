@@ -1,16 +1,24 @@
 #ifndef REDISDATABASE_H
 #define REDISDATABASE_H
+#include <functional>
+#include <istream>
 #include <string>
 #include <mutex>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include "RedisBitmap.h"
+#include "RedisSortedSet.h"
+#include "RedisString.h"
+
 class RedisDatabase {
 public:
     static RedisDatabase& getInstance();
     std::mutex db_mutex;
     // common commands
-    bool flushAll();
+    // async: swap the keyspace out and let RedisLazyFree release the old one
+    bool flushAll(bool async = false);
 
     //kv
     void set(const std::string& key, const std::string& value);
@@ -18,8 +26,15 @@ public:
     std::vector<std::string> keys();
     std::string type(const std::string& key);
     bool del(const std::string& key);
+    // like del, but big values are freed by the lazy free thread
+    bool unlink(const std::string& key);
+    bool exists(const std::string& key);
     // expire
     bool expire(const std::string& key, std::string& seconds);
+    // delete a batch of expired keys, returns how many were found
+    size_t activeExpireCycle();
+    // remaining time to live in ms, -1 without expire, -2 when the key does not exist
+    long long pttl(const std::string& key);
     // rename
     bool rename(const std::string& oldkey, const std::string& newkey);
 
@@ -44,7 +59,76 @@ public:
     std::unordered_map<std::string, std::string> hgetall(const std::string& key);
     bool hmset(const std::string& key, const std::vector<std::pair<std::string, std::string>>& values);
 
+    // sorted set operations
+    size_t zadd(const std::string& key, const std::vector<std::pair<double, std::string>>& members, int flags, bool ch);
+    // false when the increment produces NaN (e.g. +inf + -inf)
+    bool zincrby(const std::string& key, const std::string& member, double increment, int flags,
+                 ZAddResult& result, double& newScore);
+    size_t zrem(const std::string& key, const std::vector<std::string>& members);
+    bool zscore(const std::string& key, const std::string& member, double& score);
+    ssize_t zcard(const std::string& key);
+    long zrank(const std::string& key, const std::string& member, bool reverse);
+    std::vector<std::pair<std::string, double>> zrange(const std::string& key, long start, long stop, bool reverse);
+    std::vector<std::pair<std::string, double>> zrangeByScore(const std::string& key, const ZScoreRange& range,
+                                                              bool reverse, long offset, long limit);
+    std::vector<std::pair<std::string, double>> zrangeByLex(const std::string& key, const ZLexRange& range,
+                                                            bool reverse, long offset, long limit);
+    size_t zcount(const std::string& key, const ZScoreRange& range);
+
+    // HyperLogLog, stored as strings in kv_store
+    // 1 when a register changed or the key was created, -1 when the value is not a HyperLogLog
+    int pfadd(const std::string& key, const std::vector<std::string>& elements);
+    // cardinality of the union, -1 when some value is not a HyperLogLog
+    long long pfcount(const std::vector<std::string>& keys);
+    // union of dest and sources into dest, false when some value is not a HyperLogLog
+    bool pfmerge(const std::string& dest, const std::vector<std::string>& sources);
+
+    // bitmaps, on strings in kv_store
+    // returns the previous bit
+    int setbit(const std::string& key, uint64_t offset, int bit);
+    int getbit(const std::string& key, uint64_t offset);
+    uint64_t bitcount(const std::string& key, long long start, long long end, bool bitUnit);
+    // without an explicit end, a clear bit is found right past the end of the string
+    long long bitpos(const std::string& key, int bit, long long start, long long end, bool hasEnd, bool bitUnit);
+    // returns the size of dest, which is deleted when that is 0
+    size_t bitop(BitOp op, const std::string& dest, const std::vector<std::string>& sources);
+    // one reply per op, false for the ones skipped by OVERFLOW FAIL
+    std::vector<std::pair<bool, int64_t>> bitfield(const std::string& key, const std::vector<BitfieldOp>& ops);
+
+    // DUMP / RESTORE: self contained binary encoding of one value
+    bool dumpKey(const std::string& key, std::string& payload);
+    // same, with the remaining time to live read under the same lock (0 without expire)
+    bool dumpKey(const std::string& key, std::string& payload, long long& ttlMs);
+    // MIGRATE: unlink key only if it still holds the value payload was dumped from
+    bool unlinkIfUnchanged(const std::string& key, const std::string& payload);
+    // fails (with the reply in error) on a bad payload or when key exists and !replace
+    bool restoreKey(const std::string& key, const std::string& payload, long long ttlMs, bool replace,
+                    std::string& error);
+
+    // MEMORY USAGE: estimated bytes of key and value, -1 when the key does not exist.
+    // Containers measure samples elements and extrapolate, 0 measures all of them
+    long long memoryUsage(const std::string& key, size_t samples);
+    // big key scan: calls visit(key, type, elements, bytes) for the keys of the next
+    // buckets hash buckets, holding db_mutex only for them. Returns false once every
+    // store was walked. A store rehashed in between is walked again from its first
+    // bucket, so every key that lives through the scan is seen, some of them twice.
+    struct KeyScanCursor {
+        int store = 0;
+        size_t bucket = 0;
+        size_t bucket_count = 0; // of the store being walked, when the last step ended
+        size_t restarts = 0;     // walks started over after a rehash
+    };
+    using KeySizeVisitor = std::function<void(const std::string&, const char*, size_t, size_t)>;
+    bool scanKeySizes(KeyScanCursor& cursor, size_t buckets, size_t samples, const KeySizeVisitor& visit);
+
+    // cluster mode: index of the keys of every hash slot. Enabled before load(),
+    // it is filled by the load workers
+    void enableSlotIndex();
+    size_t countKeysInSlot(int slot);
+    std::vector<std::string> getKeysInSlot(int slot, size_t count);
+
     // Persistance: Dump / load database from file
+    // the snapshot is split in segments decoded in parallel by load()
     bool dump(const std::string& filename);
     bool load(const std::string& filename);
 
@@ -54,11 +138,33 @@ private:
     RedisDatabase(const RedisDatabase&) = delete;
     RedisDatabase& operator=(const RedisDatabase&) = delete;
 
+    // remove key from every store, handing its value to RedisLazyFree; db_mutex must be held
+    bool detachKey(const std::string& key);
+    // db_mutex must be held
+    bool keyExists(const std::string& key);
+    // DUMP encoding of key, false when it does not exist; db_mutex must be held
+    bool encodeKey(const std::string& key, std::string& payload);
+    void slotAdd(const std::string& key);
+    // compress a copy of the element a push made interior, taken under
+    // db_mutex, and swap it in if the element is still there unchanged
+    void compressPushed(const std::string& key, const std::string& interior, bool head);
+    // invalidate the read cache and client side caches of key (CLIENT TRACKING)
+    void signalModifiedKey(const std::string& key);
+    // drops key from the slot index unless it still exists in some store
+    void slotRemove(const std::string& key);
+    // segmented snapshot mapped in memory
+    bool loadSnapshot(const char* data, size_t size);
+    // snapshots written before the segmented format
+    bool loadText(std::istream& ifs);
 
-    std::unordered_map<std::string, std::string> kv_store;
-    std::unordered_map<std::string, std::vector<std::string>> list_store;
+    std::unordered_map<std::string, RedisString> kv_store;
+    std::unordered_map<std::string, std::vector<RedisString>> list_store;
     std::unordered_map<std::string, std::unordered_map<std::string, std::string>> hash_store;
+    std::unordered_map<std::string, RedisSortedSet> zset_store;
     std::unordered_map<std::string, std::chrono::steady_clock::time_point> expire_store;
+    // empty unless cluster mode is enabled
+    std::vector<std::unordered_set<std::string>> slot_keys;
+    size_t expire_cursor = 0; // next expire_store bucket visited by activeExpireCycle
 };
 
 #endif
@@ -0,0 +1,71 @@
+#ifndef REDISEPOCH_H
+#define REDISEPOCH_H
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Epoch based reclamation for objects read without a lock (RedisReadCache).
+// A reader pins the current epoch with a Guard while it holds pointers to
+// shared objects. A writer unpublishes an object, then retires it: it is
+// freed once the global epoch moved two steps past the one it was retired
+// in, which can only happen after every thread pinned back then unpinned.
+class RedisEpoch {
+    struct ThreadRecord;
+
+public:
+    static RedisEpoch& getInstance();
+
+    class Guard {
+    public:
+        Guard();
+        ~Guard();
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+    private:
+        ThreadRecord* record;
+    };
+
+    template <typename T>
+    void retire(T* object) {
+        retire(object, [](void* p) { delete static_cast<T*>(p); });
+    }
+    void retire(void* object, void (*deleter)(void*));
+    // retired objects not freed yet
+    size_t pending();
+
+private:
+    RedisEpoch() = default;
+    ~RedisEpoch() = default;
+    RedisEpoch(const RedisEpoch&) = delete;
+    RedisEpoch& operator=(const RedisEpoch&) = delete;
+
+    // retires between two attempts to free
+    static const size_t COLLECT_BATCH = 64;
+
+    struct alignas(64) ThreadRecord {
+        std::atomic<uint64_t> epoch{0}; // pinned epoch, 0 when not pinned
+        std::atomic<bool> in_use{false};
+        ThreadRecord* next = nullptr;
+    };
+    struct Retired {
+        uint64_t epoch;
+        void* object;
+        void (*deleter)(void*);
+    };
+
+    // record of the calling thread, handed to another thread once it exits
+    ThreadRecord* localRecord();
+    // moves the epoch on when no thread is pinned to an older one
+    bool tryAdvance();
+
+    std::atomic<uint64_t> global_epoch{1};
+    std::atomic<ThreadRecord*> records{nullptr}; // never shrinks
+    std::mutex retire_mutex;
+    std::vector<Retired> limbo;
+    size_t retired_since_collect = 0;
+};
+
+#endif //REDISEPOCH_H
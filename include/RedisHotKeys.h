@@ -0,0 +1,69 @@
+#ifndef REDISHOTKEYS_H
+#define REDISHOTKEYS_H
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Access frequency of keys (HOTKEYS).
+// Each command is sampled with probability 1 / HOTKEYS_SAMPLE_RATE, drawn from
+// a per thread generator so short lived connections are sampled too, and adds
+// its keys to a count-min sketch of relaxed atomic counters, so the serving
+// path never takes a lock for keys that are not hot. Keys whose estimate is
+// high enough to be in the top HOTKEYS_MAX_COUNT are kept in a small
+// candidate table. Every HOTKEYS_DECAY_SECONDS all counts are halved, so they
+// follow the recent access rate instead of growing forever.
+class RedisHotKeys {
+public:
+    static const unsigned HOTKEYS_SAMPLE_RATE = 8;
+    static const int HOTKEYS_DECAY_SECONDS = 10;
+    static const size_t HOTKEYS_MAX_COUNT = 128;
+    static const int SKETCH_DEPTH = 4;
+    static const size_t SKETCH_WIDTH = 1 << 16;
+
+    static RedisHotKeys& getInstance();
+
+    // true for the commands whose keys should be recorded
+    bool sample() {
+        // xorshift32, seeded differently in every thread
+        thread_local uint32_t state = seed();
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state % HOTKEYS_SAMPLE_RATE == 0;
+    }
+    void record(const std::vector<std::string>& keys);
+
+    // hottest keys with their estimated accesses per second, highest first
+    std::vector<std::pair<std::string, uint64_t>> top(size_t count);
+
+private:
+    RedisHotKeys();
+    ~RedisHotKeys() = default;
+    RedisHotKeys(const RedisHotKeys&) = delete;
+    RedisHotKeys& operator=(const RedisHotKeys&) = delete;
+
+    // nonzero seed for the sample() generator of a new thread
+    uint32_t seed();
+    // adds one sample, returns the new estimate (minimum over the rows)
+    uint32_t increment(const std::string& key);
+    void decayIfDue();
+    // sampled and halved counts back to accesses per second
+    double rate(uint32_t count) const;
+
+    std::vector<std::atomic<uint32_t>> sketch; // SKETCH_DEPTH rows of SKETCH_WIDTH counters
+    std::chrono::steady_clock::time_point started;
+    std::atomic<int64_t> last_decay_ms{0}; // since started
+    std::atomic<uint64_t> decays{0};
+    std::atomic<uint64_t> seeds{0};
+
+    std::mutex top_mutex;
+    std::unordered_map<std::string, uint32_t> top_keys; // candidates -> last estimate
+    std::atomic<uint32_t> admit_count{1};               // estimate needed to enter a full top_keys
+};
+
+#endif //REDISHOTKEYS_H
@@ -0,0 +1,52 @@
+#ifndef REDISHYPERLOGLOG_H
+#define REDISHYPERLOGLOG_H
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// HyperLogLog with 16384 registers, kept in a plain string value using the
+// Redis layout, so GET/SET/DUMP/RESTORE move it around untouched:
+// "HYLL" | encoding | 3 unused | 8 bytes cached cardinality | registers
+// Dense: 16384 6-bit registers packed in 12288 bytes.
+// Sparse: run length opcodes (ZERO, XZERO, VAL), used while every register
+// is <= 32 and the value stays under HLL_SPARSE_MAX_BYTES.
+// Merging and the estimate work on one byte per register and use AVX2 when
+// the CPU has it.
+class RedisHyperLogLog {
+public:
+    static const int HLL_P = 14;
+    static const int HLL_Q = 64 - HLL_P;
+    static const int HLL_REGISTERS = 1 << HLL_P;
+    static const size_t HLL_HDR_SIZE = 16;
+    static const size_t HLL_DENSE_SIZE = HLL_HDR_SIZE + (HLL_REGISTERS * 6 + 7) / 8;
+    static const size_t HLL_SPARSE_MAX_BYTES = 3000;
+    static const int HLL_SPARSE_VAL_MAX = 32;
+
+    // empty HyperLogLog (sparse)
+    static std::string create();
+    static bool isValid(const std::string& hll);
+
+    // true when some register changed; hll must be valid
+    static bool add(std::string& hll, const std::vector<std::string>& elements);
+    // cardinality, served from and stored into the header cache
+    static uint64_t count(std::string& hll);
+
+    // registers: HLL_REGISTERS bytes, one per register
+    // regs[i] = max(regs[i], register i of hll)
+    static void mergeInto(const std::string& hll, uint8_t* regs);
+    static uint64_t estimate(const uint8_t* regs);
+    // sparse when it fits, dense otherwise
+    static std::string fromRegisters(const uint8_t* regs);
+
+private:
+    static bool isSparse(const std::string& hll) { return hll[4] == 1; }
+    static void invalidateCache(std::string& hll) { hll[15] |= static_cast<char>(0x80); }
+    // register index and run length of trailing zeros + 1 for one element
+    static int patLen(const std::string& element, long& index);
+    static bool denseSet(std::string& hll, long index, uint8_t count);
+    // walks the sparse opcodes, regs[i] = max(regs[i], register i) unless
+    // regs is null; false when they do not describe exactly HLL_REGISTERS
+    static bool sparseToRegisters(const char* p, size_t size, uint8_t* regs);
+};
+
+#endif //REDISHYPERLOGLOG_H
@@ -0,0 +1,56 @@
+#ifndef REDISLAZYFREE_H
+#define REDISLAZYFREE_H
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+// Background destruction of big values (UNLINK, FLUSHALL ASYNC, overwrites).
+// The caller detaches the value from the keyspace in O(1) (node extract or
+// map swap) and hands it over here; values whose free effort (roughly the
+// number of allocations to release) is small are still destroyed inline,
+// since queueing them would cost more than freeing them.
+class RedisLazyFree {
+public:
+    static const size_t LAZYFREE_THRESHOLD = 64;
+
+    static RedisLazyFree& getInstance();
+
+    template <typename T>
+    void free(T&& value, size_t effort) {
+        if (effort <= LAZYFREE_THRESHOLD) return; // value dies with the caller's copy
+        freeAsync(std::forward<T>(value));
+    }
+
+    // always free in the background (FLUSHALL ASYNC)
+    template <typename T>
+    void freeAsync(T&& value) {
+        std::shared_ptr<void> object = std::make_shared<typename std::decay<T>::type>(std::forward<T>(value));
+        enqueue(std::move(object));
+    }
+
+    // objects queued and not freed yet
+    size_t pending() const { return pending_objects; }
+
+private:
+    RedisLazyFree();
+    ~RedisLazyFree();
+    RedisLazyFree(const RedisLazyFree&) = delete;
+    RedisLazyFree& operator=(const RedisLazyFree&) = delete;
+
+    void enqueue(std::shared_ptr<void> object);
+    void worker();
+
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    std::deque<std::shared_ptr<void>> queue;
+    std::atomic<size_t> pending_objects;
+    bool stopping;
+    std::thread thread;
+};
+
+#endif //REDISLAZYFREE_H
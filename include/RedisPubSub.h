@@ -0,0 +1,46 @@
+#ifndef REDISPUBSUB_H
+#define REDISPUBSUB_H
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "RedisClient.h"
+
+class RedisPubSub {
+public:
+    static RedisPubSub& getInstance();
+
+    // each call returns the RESP replies for every channel/pattern given
+    std::string subscribe(RedisClient& client, const std::vector<std::string>& channels);
+    std::string unsubscribe(RedisClient& client, const std::vector<std::string>& channels);
+    std::string psubscribe(RedisClient& client, const std::vector<std::string>& patterns);
+    std::string punsubscribe(RedisClient& client, const std::vector<std::string>& patterns);
+    // remove every subscription of a client that is disconnecting
+    void removeClient(RedisClient& client);
+
+    // deliver a message, returns the number of clients that queued it; the
+    // subscribers are woken once pubsub_mutex is released
+    size_t publish(const std::string& channel, const std::string& message);
+    // whether the client is subscribed to exactly this channel
+    bool isSubscribed(RedisClient& client, const std::string& channel);
+
+    // glob-style matching used by PSUBSCRIBE (*, ?, [abc], [^a-z], \x)
+    static bool matchPattern(const std::string& pattern, const std::string& str);
+
+private:
+    RedisPubSub() = default;
+    ~RedisPubSub() = default;
+    RedisPubSub(const RedisPubSub&) = delete;
+    RedisPubSub& operator=(const RedisPubSub&) = delete;
+
+    std::mutex pubsub_mutex;
+    // held shared by publish() while it wakes subscribers outside pubsub_mutex,
+    // and exclusively by removeClient(), so a woken client is still alive
+    std::shared_mutex wake_mutex;
+    std::unordered_map<std::string, std::vector<RedisClient*>> channel_subscribers;
+    std::unordered_map<std::string, std::vector<RedisClient*>> pattern_subscribers;
+};
+
+#endif //REDISPUBSUB_H
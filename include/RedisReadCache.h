@@ -0,0 +1,86 @@
+#ifndef REDISREADCACHE_H
+#define REDISREADCACHE_H
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Lock free read path of GET and HGET (--read-cache-slots).
+// A set associative cache in front of kv_store and hash_store. Each way holds
+// an immutable entry (key, hash field, value) that readers look up without
+// taking any lock. Every modification of a key bumps the version of its set
+// (signalModifiedKey), which turns all cached entries of the key stale at
+// once, so a hit never returns a value older than the last completed write.
+// A value read under db_mutex is published after the lock is released, and
+// only on its second miss in a short window, so keys read once cost neither
+// an allocation nor a look at their version.
+// Replaced entries are freed through RedisEpoch. Misses, compressed and
+// big values go through the locked path.
+class RedisReadCache {
+public:
+    static const size_t DEFAULT_SLOTS = 1 << 16;
+    static const size_t WAYS = 4;
+    // bigger values are read under db_mutex, where the copy dominates anyway
+    static const size_t MAX_VALUE_SIZE = 1024;
+
+    static RedisReadCache& getInstance();
+    // before serving; rounded up to a power of two of at least WAYS, 0 disables the cache
+    void setSlots(size_t count);
+    size_t slots() const { return set_count * WAYS; }
+
+    // computed once per command and handed to the calls below
+    static size_t hashKey(const std::string& key);
+
+    // no lock taken, false on a miss; admit tells whether the value is then worth publishing
+    bool get(const std::string& key, size_t keyHash, std::string& value, bool& admit);
+    bool hget(const std::string& key, size_t keyHash, const std::string& field, std::string& value, bool& admit);
+
+    // db_mutex must be held: the version a value read under it is published with
+    uint64_t version(size_t keyHash);
+    // no lock needed; the entry is stale from the start if key changed after version()
+    void publish(const std::string& key, size_t keyHash, const std::string& value, uint64_t version);
+    void publish(const std::string& key, size_t keyHash, const std::string& field, const std::string& value,
+                 uint64_t version);
+
+    // db_mutex must be held
+    void invalidate(const std::string& key);
+    void clear();
+
+private:
+    RedisReadCache();
+    ~RedisReadCache() = default;
+    RedisReadCache(const RedisReadCache&) = delete;
+    RedisReadCache& operator=(const RedisReadCache&) = delete;
+
+    struct Entry {
+        size_t hash;
+        size_t key_hash;
+        uint64_t version; // of the key's set when the value was read
+        bool is_field;    // hash field rather than string value
+        std::string key;
+        std::string field;
+        std::string value;
+    };
+    // one cache line, so a miss touches a single line before db_mutex
+    struct alignas(64) Set {
+        std::atomic<Entry*> ways[WAYS];
+        std::atomic<uint64_t> version;        // of the keys hashed to this set
+        std::atomic<uint16_t> tags[WAYS];     // hash bits of each way, a miss is told without a guard
+        std::atomic<uint32_t> seen[WAYS];     // hash bits of the last misses
+    };
+    static_assert(sizeof(Set) == 64, "a set must fit in one cache line");
+
+    Set& setOf(size_t hash) { return sets[hash & set_mask]; }
+    bool lookup(bool isField, const std::string& key, size_t keyHash, const std::string& field, std::string& value,
+                bool& admit);
+    void store(bool isField, const std::string& key, size_t keyHash, const std::string& field,
+               const std::string& value, uint64_t version);
+    bool matches(const Entry* entry, size_t hash, bool isField, const std::string& key, const std::string& field) const;
+
+    std::unique_ptr<Set[]> sets;
+    size_t set_count = 0;
+    size_t set_mask = 0;
+};
+
+#endif //REDISREADCACHE_H
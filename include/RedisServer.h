@@ -5,10 +5,19 @@
 #include <unistd.h>
 #include <string>
 
+class RedisCommandHandler;
+
+// networking model used by RedisServer::run
+enum class RedisIoBackend {
+    Threads, // one thread per client, blocking poll/recv/send
+    Uring,   // single io_uring event loop, falls back to Threads if unsupported
+};
+
 class RedisServer {
 
 public:
-    RedisServer(int port);
+    RedisServer(int port, RedisIoBackend backend = RedisIoBackend::Threads,
+                const std::string& dbfilename = "dump.my_rdb");
     void run();
     void shutdown();
 
@@ -16,6 +25,10 @@ private:
     int port;
     int server_socket;
     std::atomic<bool> running;
+    RedisIoBackend backend;
+    std::string dbfilename; // snapshot written on shutdown
+
+    void runThreads(RedisCommandHandler& cmdHandler);
 
     // isso aqui eh pra fazer o que se chama de
     // graceful shutdown
@@ -0,0 +1,133 @@
+#ifndef REDISSORTEDSET_H
+#define REDISSORTEDSET_H
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// ZADD options
+enum ZAddFlags {
+    ZADD_NX = 1 << 0,   // only add new members
+    ZADD_XX = 1 << 1,   // only update existing members
+    ZADD_GT = 1 << 2,   // only update when the new score is greater
+    ZADD_LT = 1 << 3,   // only update when the new score is lower
+    ZADD_INCR = 1 << 4, // increment the score instead of setting it
+};
+
+// result of a single RedisSortedSet::add
+enum ZAddResult {
+    ZADD_NOP,       // aborted because of NX/XX/GT/LT
+    ZADD_ADDED,
+    ZADD_UPDATED,
+    ZADD_UNCHANGED, // member exists and already has that score
+};
+
+// score interval, e.g. "(1" "+inf"
+struct ZScoreRange {
+    double min = 0, max = 0;
+    bool minex = false, maxex = false; // exclusive bounds
+};
+
+// lexicographic interval, e.g. "[a" "(c", "-" and "+" are the infinite bounds
+struct ZLexRange {
+    std::string min, max;
+    bool minex = false, maxex = false;
+    bool mininf = false, maxinf = false;
+};
+
+// Sorted set: members ordered by (score, member).
+// Small sets live in a packed buffer of [score][len][member] entries; once
+// they grow past ZSET_MAX_PACKED_ENTRIES / ZSET_MAX_PACKED_VALUE they are
+// converted to a skiplist (with span counts for O(log n) ranks) plus a
+// member -> score hash for O(1) ZSCORE.
+class RedisSortedSet {
+public:
+    static const size_t ZSET_MAX_PACKED_ENTRIES = 128;
+    static const size_t ZSET_MAX_PACKED_VALUE = 64;
+
+    RedisSortedSet();
+    ~RedisSortedSet();
+    RedisSortedSet(const RedisSortedSet& other);
+    RedisSortedSet(RedisSortedSet&& other) noexcept;
+    RedisSortedSet& operator=(RedisSortedSet other);
+
+    size_t size() const;
+    bool isPacked() const { return head == nullptr; }
+    // estimated heap bytes (MEMORY USAGE); samples elements are measured
+    // and extrapolated to the whole set, 0 measures all of them
+    size_t memoryUsage(size_t samples) const;
+
+    // add or update a member according to ZAddFlags; newScore receives the
+    // resulting score. Returns false only when INCR produced a NaN
+    bool add(const std::string& member, double score, int flags, ZAddResult& result, double& newScore);
+    bool remove(const std::string& member);
+    bool score(const std::string& member, double& score) const;
+    // 0-based rank, -1 when the member does not exist
+    long rank(const std::string& member, bool reverse) const;
+
+    // elements between ranks start..stop (inclusive, already normalized)
+    std::vector<std::pair<std::string, double>> rangeByRank(size_t start, size_t stop, bool reverse) const;
+    // offset/limit follow ZRANGE ... LIMIT, limit < 0 means no limit
+    std::vector<std::pair<std::string, double>> rangeByScore(const ZScoreRange& range, bool reverse,
+                                                             long offset, long limit) const;
+    std::vector<std::pair<std::string, double>> rangeByLex(const ZLexRange& range, bool reverse,
+                                                           long offset, long limit) const;
+    size_t count(const ZScoreRange& range) const;
+
+    // accepts what strtod does plus "inf"/"+inf"/"-inf", rejects NaN
+    static bool parseScore(const std::string& input, double& score);
+    static bool parseScoreRange(const std::string& min, const std::string& max, ZScoreRange& range);
+    static bool parseLexRange(const std::string& min, const std::string& max, ZLexRange& range);
+    static std::string formatScore(double score);
+
+private:
+    struct Node;
+    struct Level {
+        Node* forward;
+        size_t span; // number of nodes skipped by following forward
+    };
+    struct Node {
+        std::string member;
+        double score;
+        Node* backward;
+        std::vector<Level> level;
+    };
+    static const int ZSKIPLIST_MAXLEVEL = 32;
+
+    // packed encoding helpers
+    struct PackedEntry {
+        size_t offset; // offset of the entry inside the packed buffer
+        double score;
+        std::string member;
+    };
+    std::vector<PackedEntry> unpack() const;
+    bool packedFind(const std::string& member, PackedEntry& entry) const;
+    void packedInsert(const std::string& member, double score);
+    void packedErase(const PackedEntry& entry);
+    void convertToSkiplist();
+
+    // skiplist helpers
+    static int randomLevel();
+    Node* slInsert(const std::string& member, double score);
+    void slDelete(const std::string& member, double score);
+    Node* slNodeByRank(size_t rank) const; // 1-based
+    void slFree();
+
+    // number of elements that satisfy pred; pred must hold for a prefix of the order
+    size_t countWhile(const std::function<bool(double, const std::string&)>& pred) const;
+    // [first, end) are forward ranks of the elements matching a score/lex range
+    std::vector<std::pair<std::string, double>> rangeByBounds(size_t first, size_t end, bool reverse,
+                                                              long offset, long limit) const;
+
+    std::string packed;
+    size_t packed_count;
+
+    Node* head;
+    Node* tail;
+    int levels;
+    size_t length;
+    std::unordered_map<std::string, double> dict;
+};
+
+#endif //REDISSORTEDSET_H
@@ -0,0 +1,40 @@
+#ifndef REDISSTRING_H
+#define REDISSTRING_H
+#include <cstdint>
+#include <string>
+
+// String value of kv_store and element of list_store: the raw bytes, or their
+// RedisCompression form once compress() found it worthwhile. Reads go through
+// value() / view(). Bitmap and HyperLogLog commands, reads included, use
+// raw(), which decompresses once and leaves the value uncompressed until it is
+// stored again, so they stay O(1) per call on a value loaded compressed.
+// Compressed values are counted in the INFO memory stats while they live.
+class RedisString {
+public:
+    RedisString() = default;
+    RedisString(std::string value) : bytes(std::move(value)) {}
+    RedisString(const RedisString& other);
+    RedisString(RedisString&& other) noexcept;
+    RedisString& operator=(RedisString other) noexcept;
+    ~RedisString();
+
+    bool isCompressed() const { return raw_size != 0; }
+    // size of the raw value
+    size_t size() const { return isCompressed() ? raw_size : bytes.size(); }
+    std::string value() const;
+    // the raw value, decompressed into scratch when needed
+    const std::string& view(std::string& scratch) const;
+    std::string& raw();
+    bool operator==(const std::string& other) const;
+
+    // compressed when at least the configured threshold and it saves space
+    void compress();
+    // heap bytes held (MEMORY USAGE)
+    size_t allocated() const;
+
+private:
+    std::string bytes;
+    uint32_t raw_size = 0; // 0: bytes is the raw value
+};
+
+#endif //REDISSTRING_H
@@ -0,0 +1,71 @@
+#ifndef REDISTRACKING_H
+#define REDISTRACKING_H
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "RedisClient.h"
+
+// Server-assisted client side caching (CLIENT TRACKING).
+// Default mode remembers which clients read which keys and sends one
+// invalidation the next time the key changes. BCAST mode sends an
+// invalidation for every changed key that starts with one of the client's
+// prefixes. Invalidations are RESP3 pushes to the client itself, or pub/sub
+// messages on __redis__:invalidate to the REDIRECT client for RESP2, which
+// must be subscribed to that channel to receive them.
+//
+// As in Redis, an invalidation can overtake the reply of a read that is
+// still in flight, so a client must not cache a value whose key was
+// invalidated while the read was pending.
+class RedisTracking {
+public:
+    static const size_t TRACKING_TABLE_MAX_KEYS = 1000000;
+
+    static RedisTracking& getInstance();
+
+    // every connection is registered so it can be a REDIRECT target
+    void addClient(RedisClient& client);
+    void removeClient(RedisClient& client);
+    RedisClient* findClient(uint64_t id);
+
+    // returns the reply for CLIENT TRACKING on/off
+    std::string enable(RedisClient& client, uint64_t redirect, bool bcast, const std::vector<std::string>& prefixes);
+    std::string disable(RedisClient& client);
+
+    // default mode: client read keys and may cache them
+    void rememberKeys(RedisClient& client, const std::vector<std::string>& keys);
+    // key changed: invalidate it for every client that may have cached it
+    void invalidateKey(const std::string& key);
+    // FLUSHALL: every tracking client drops its whole cache
+    void invalidateAll();
+
+    // bound on the keys remembered in default mode; past it keys are evicted
+    // by sending their invalidations early
+    void setMaxKeys(size_t maxKeys);
+    size_t trackedKeys();
+
+private:
+    RedisTracking() = default;
+    ~RedisTracking() = default;
+    RedisTracking(const RedisTracking&) = delete;
+    RedisTracking& operator=(const RedisTracking&) = delete;
+
+    // tracking_mutex must be held; push is the RESP3 form, message the
+    // RESP2 pub/sub form of the same invalidation, sent only to a RESP2
+    // client subscribed to __redis__:invalidate
+    void deliver(uint64_t id, const RedisReply& push, const RedisReply& message);
+    void disableLocked(RedisClient& client);
+
+    std::mutex tracking_mutex;
+    std::atomic<size_t> tracking_clients{0}; // fast path for invalidateKey
+    size_t max_keys = TRACKING_TABLE_MAX_KEYS;
+    std::unordered_map<uint64_t, RedisClient*> clients;
+    std::unordered_map<std::string, std::unordered_set<uint64_t>> tracking_table; // key -> client ids
+    std::unordered_map<std::string, std::unordered_set<uint64_t>> prefix_table;   // BCAST prefix -> client ids
+};
+
+#endif //REDISTRACKING_H
@@ -0,0 +1,89 @@
+#ifndef REDISURINGBACKEND_H
+#define REDISURINGBACKEND_H
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "RedisCommandHandler.h"
+
+// Single threaded event loop on top of io_uring (raw syscalls, no liburing).
+// - one multishot accept for the listening socket
+// - one multishot recv per client, reading into a provided buffer ring
+// - replies are queued as SENDMSG SQEs and submitted together with the wait
+// so a loop iteration costs one io_uring_enter no matter how many clients
+// and pipelined commands it served.
+class RedisUringBackend {
+public:
+    RedisUringBackend(int listenFd, RedisCommandHandler& cmdHandler, std::atomic<bool>& running);
+    ~RedisUringBackend();
+
+    // set up the rings; false (with the reason in error) when the kernel
+    // lacks io_uring, provided buffer rings or multishot recv
+    bool init(std::string& error);
+    void run();
+
+private:
+    struct Connection;
+
+    RedisUringBackend(const RedisUringBackend&) = delete;
+    RedisUringBackend& operator=(const RedisUringBackend&) = delete;
+
+    struct io_uring_sqe* getSqe();
+    int submit(unsigned waitFor);
+    bool probeMultishotRecv();
+
+    void armAccept();
+    void armRecv(Connection* conn);
+    void armWake();
+    void scheduleSend(Connection* conn);
+    void startClose(Connection* conn);
+    void maybeDestroy(Connection* conn);
+    void recycleBuffer(uint16_t bid);
+
+    void handleAccept(int res, uint32_t flags);
+    void handleRecv(Connection* conn, int res, uint32_t flags);
+    void handleSend(Connection* conn, int res);
+    void handleWake(uint32_t flags);
+
+    int listen_fd;
+    RedisCommandHandler& handler;
+    std::atomic<bool>& running;
+
+    int ring_fd;
+    // submission queue
+    void* sq_ring;
+    size_t sq_ring_size;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned sq_entries;
+    unsigned sq_local_tail;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    // completion queue (shares the sq mapping, IORING_FEAT_SINGLE_MMAP)
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+
+    // provided buffer ring used by the multishot recvs
+    struct io_uring_buf_ring* buf_ring;
+    size_t buf_ring_size;
+    char* buffers;
+    uint16_t buf_local_tail;
+
+    int wake_fd;
+    std::thread::id loop_thread;
+    std::unordered_set<Connection*> connections;
+    std::vector<Connection*> pending_sends;
+    // output queued by other threads, drained after a wake_fd completion
+    std::mutex remote_mutex;
+    std::vector<Connection*> remote_pending;
+};
+
+#endif //REDISURINGBACKEND_H
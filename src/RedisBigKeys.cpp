@@ -0,0 +1,95 @@
+#include "../include/RedisBigKeys.h"
+#include "../include/RedisDatabase.h"
+
+#include <algorithm>
+#include <sstream>
+#include <thread>
+
+RedisBigKeys& RedisBigKeys::getInstance() {
+    static RedisBigKeys instance;
+    return instance;
+}
+
+bool RedisBigKeys::start(size_t top) {
+    std::lock_guard<std::mutex> lock(report_mutex);
+    if (running) return false;
+    running = true;
+    finished = false;
+    top_count = top < 1 ? 1 : top > MAX_TOP ? MAX_TOP : top;
+    scanned_keys = 0;
+    restarts = 0;
+    by_elements.clear();
+    by_bytes.clear();
+    started = std::chrono::steady_clock::now();
+    std::thread(&RedisBigKeys::run, this).detach();
+    return true;
+}
+
+void RedisBigKeys::run() {
+    RedisDatabase& db = RedisDatabase::getInstance();
+    RedisDatabase::KeyScanCursor cursor;
+    auto visit = [this](const std::string& key, const char* type, size_t elements, size_t bytes) {
+        std::lock_guard<std::mutex> lock(report_mutex);
+        consider(key, type, elements, bytes);
+    };
+    bool more = true;
+    while (more) {
+        more = db.scanKeySizes(cursor, SCAN_BUCKETS, SCAN_SAMPLES, visit);
+        {
+            std::lock_guard<std::mutex> lock(report_mutex);
+            restarts = cursor.restarts;
+        }
+        std::this_thread::yield(); // let waiting commands take db_mutex
+    }
+    std::lock_guard<std::mutex> lock(report_mutex);
+    running = false;
+    finished = true;
+    stopped = std::chrono::steady_clock::now();
+}
+
+// sorted insert into a top list, biggest first; a key seen again replaces its entry
+static void keepTop(std::vector<RedisBigKeys::KeySize>& top, size_t limit, const std::string& key, size_t elements,
+                    size_t bytes, size_t RedisBigKeys::KeySize::*metric) {
+    RedisBigKeys::KeySize entry{std::string(), elements, bytes};
+    if (top.size() == limit && top.back().*metric >= entry.*metric) return;
+    auto seen = std::find_if(top.begin(), top.end(), [&key](const RedisBigKeys::KeySize& e) { return e.key == key; });
+    if (seen != top.end()) top.erase(seen);
+    auto pos = std::upper_bound(top.begin(), top.end(), entry,
+                                [metric](const auto& a, const auto& b) { return a.*metric > b.*metric; });
+    pos = top.insert(pos, entry);
+    pos->key = key;
+    if (top.size() > limit) top.pop_back();
+}
+
+void RedisBigKeys::consider(const std::string& key, const char* type, size_t elements, size_t bytes) {
+    scanned_keys++;
+    keepTop(by_elements[type], top_count, key, elements, bytes, &KeySize::elements);
+    keepTop(by_bytes[type], top_count, key, elements, bytes, &KeySize::bytes);
+}
+
+std::string RedisBigKeys::report() {
+    std::lock_guard<std::mutex> lock(report_mutex);
+    std::ostringstream out;
+    out << "# Bigkeys\r\n";
+    out << "status:" << (running ? "running" : finished ? "done" : "idle") << "\r\n";
+    out << "scanned_keys:" << scanned_keys << "\r\n";
+    // keys of a store walked again after a rehash are counted again
+    out << "rehash_restarts:" << restarts << "\r\n";
+    if (running || finished) {
+        auto end = running ? std::chrono::steady_clock::now() : stopped;
+        out << "elapsed_ms:" << std::chrono::duration_cast<std::chrono::milliseconds>(end - started).count() << "\r\n";
+    }
+    // <type>_by_<elements|bytes>_<rank>:<key> elements=<n> bytes=<n>
+    for (const char* type : {"string", "list", "hash", "zset"}) {
+        for (const auto& ranking : {std::make_pair("elements", &by_elements), std::make_pair("bytes", &by_bytes)}) {
+            auto it = ranking.second->find(type);
+            if (it == ranking.second->end()) continue;
+            size_t rank = 1;
+            for (const auto& entry : it->second) {
+                out << type << "_by_" << ranking.first << "_" << rank++ << ":" << entry.key
+                    << " elements=" << entry.elements << " bytes=" << entry.bytes << "\r\n";
+            }
+        }
+    }
+    return out.str();
+}
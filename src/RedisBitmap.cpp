@@ -0,0 +1,386 @@
+#include "../include/RedisBitmap.h"
+
+#include <algorithm>
+#include <cstring>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define BITMAP_HAVE_X86_SIMD 1
+#endif
+
+/*
+ * Scalar kernels, 8 bytes at a time
+*/
+static uint64_t popcountScalar(const uint8_t* p, size_t size) {
+    uint64_t total = 0;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, p + i, sizeof(word));
+        total += __builtin_popcountll(word);
+    }
+    for (; i < size; i++) total += __builtin_popcount(p[i]);
+    return total;
+}
+
+static size_t findByteNotScalar(const uint8_t* p, size_t size, uint8_t skip) {
+    const uint64_t pattern = skip * 0x0101010101010101ULL;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, p + i, sizeof(word));
+        if (word != pattern) break;
+    }
+    for (; i < size; i++) {
+        if (p[i] != skip) return i;
+    }
+    return size;
+}
+
+static void combineScalar(BitOp op, uint8_t* dest, const uint8_t* src, size_t size, size_t i = 0) {
+    for (; i + 8 <= size; i += 8) {
+        uint64_t a, b;
+        memcpy(&a, dest + i, sizeof(a));
+        memcpy(&b, src + i, sizeof(b));
+        switch (op) {
+            case BITOP_AND: a &= b; break;
+            case BITOP_OR: a |= b; break;
+            case BITOP_XOR: a ^= b; break;
+            case BITOP_NOT: a = ~b; break;
+        }
+        memcpy(dest + i, &a, sizeof(a));
+    }
+    for (; i < size; i++) {
+        switch (op) {
+            case BITOP_AND: dest[i] &= src[i]; break;
+            case BITOP_OR: dest[i] |= src[i]; break;
+            case BITOP_XOR: dest[i] ^= src[i]; break;
+            case BITOP_NOT: dest[i] = ~src[i]; break;
+        }
+    }
+}
+
+#ifdef BITMAP_HAVE_X86_SIMD
+/*
+ * AVX2 kernels, 32 bytes at a time
+*/
+// Per nibble table lookup (pshufb), byte counts summed into 64-bit lanes with psadbw
+__attribute__((target("avx2")))
+static uint64_t popcountAVX2(const uint8_t* p, size_t size) {
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i total = zero;
+    size_t i = 0;
+    while (i + 32 <= size) {
+        // each step adds at most 8 to a byte counter: flush them before 255
+        __m256i counts = zero;
+        for (int n = 0; n < 31 && i + 32 <= size; n++, i += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+            __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low));
+            __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+            counts = _mm256_add_epi8(counts, _mm256_add_epi8(lo, hi));
+        }
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(counts, zero));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), total);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + popcountScalar(p + i, size - i);
+}
+
+__attribute__((target("avx2")))
+static size_t findByteNotAVX2(const uint8_t* p, size_t size, uint8_t skip) {
+    const __m256i pattern = _mm256_set1_epi8(static_cast<char>(skip));
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        uint32_t equal = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, pattern));
+        if (equal != 0xffffffffu) return i + __builtin_ctz(~equal);
+    }
+    return i + findByteNotScalar(p + i, size - i, skip);
+}
+
+__attribute__((target("avx2")))
+static void combineAVX2(BitOp op, uint8_t* dest, const uint8_t* src, size_t size) {
+    const __m256i ones = _mm256_set1_epi8(-1);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dest + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        switch (op) {
+            case BITOP_AND: a = _mm256_and_si256(a, b); break;
+            case BITOP_OR: a = _mm256_or_si256(a, b); break;
+            case BITOP_XOR: a = _mm256_xor_si256(a, b); break;
+            case BITOP_NOT: a = _mm256_xor_si256(b, ones); break;
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), a);
+    }
+    combineScalar(op, dest, src, size, i);
+}
+
+/*
+ * AVX-512 kernels, 64 bytes at a time
+*/
+// horizontal sum through memory: _mm512_reduce_add_epi64 trips -Wuninitialized
+// in the GCC 12 headers
+__attribute__((target("avx512f")))
+static uint64_t sumLanesAVX512(__m512i v) {
+    uint64_t lanes[8];
+    _mm512_storeu_si512(lanes, v);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] + lanes[6] + lanes[7];
+}
+
+// VPOPCNTDQ (Ice Lake and later) counts 64-bit lanes directly
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static uint64_t popcountAVX512(const uint8_t* p, size_t size) {
+    __m512i total = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        __m512i v = _mm512_loadu_si512(p + i);
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(v));
+    }
+    return sumLanesAVX512(total) + popcountScalar(p + i, size - i);
+}
+
+// Skylake-X has AVX-512BW but no VPOPCNTDQ: same nibble lookup as AVX2
+__attribute__((target("avx512f,avx512bw")))
+static uint64_t popcountAVX512BW(const uint8_t* p, size_t size) {
+    // bit counts of 0..15 in every 128-bit lane
+    const __m512i lookup = _mm512_set4_epi32(0x04030302, 0x03020201, 0x03020201, 0x02010100);
+    const __m512i low = _mm512_set1_epi8(0x0f);
+    const __m512i zero = _mm512_setzero_si512();
+    __m512i total = zero;
+    size_t i = 0;
+    while (i + 64 <= size) {
+        __m512i counts = zero;
+        for (int n = 0; n < 31 && i + 64 <= size; n++, i += 64) {
+            __m512i v = _mm512_loadu_si512(p + i);
+            __m512i lo = _mm512_shuffle_epi8(lookup, _mm512_and_si512(v, low));
+            __m512i hi = _mm512_shuffle_epi8(lookup, _mm512_and_si512(_mm512_srli_epi16(v, 4), low));
+            counts = _mm512_add_epi8(counts, _mm512_add_epi8(lo, hi));
+        }
+        total = _mm512_add_epi64(total, _mm512_sad_epu8(counts, zero));
+    }
+    return sumLanesAVX512(total) + popcountScalar(p + i, size - i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static size_t findByteNotAVX512(const uint8_t* p, size_t size, uint8_t skip) {
+    const __m512i pattern = _mm512_set1_epi8(static_cast<char>(skip));
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        __mmask64 different = _mm512_cmpneq_epi8_mask(_mm512_loadu_si512(p + i), pattern);
+        if (different) return i + __builtin_ctzll(different);
+    }
+    return i + findByteNotScalar(p + i, size - i, skip);
+}
+
+__attribute__((target("avx512f")))
+static void combineAVX512(BitOp op, uint8_t* dest, const uint8_t* src, size_t size) {
+    const __m512i ones = _mm512_set1_epi8(-1);
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        __m512i a = _mm512_loadu_si512(dest + i);
+        __m512i b = _mm512_loadu_si512(src + i);
+        switch (op) {
+            case BITOP_AND: a = _mm512_and_si512(a, b); break;
+            case BITOP_OR: a = _mm512_or_si512(a, b); break;
+            case BITOP_XOR: a = _mm512_xor_si512(a, b); break;
+            case BITOP_NOT: a = _mm512_xor_si512(b, ones); break;
+        }
+        _mm512_storeu_si512(dest + i, a);
+    }
+    combineScalar(op, dest, src, size, i);
+}
+
+enum SimdLevel { SIMD_SCALAR, SIMD_AVX2, SIMD_AVX512BW };
+
+static SimdLevel simdLevel() {
+    static const SimdLevel level = [] {
+        if (__builtin_cpu_supports("avx512bw")) return SIMD_AVX512BW;
+        if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+        return SIMD_SCALAR;
+    }();
+    return level;
+}
+
+static bool hasPopcntDQ() {
+    static const bool popcntdq = __builtin_cpu_supports("avx512vpopcntdq");
+    return popcntdq;
+}
+#endif
+
+/*
+ * Runtime dispatch
+*/
+uint64_t RedisBitmap::popcount(const uint8_t* p, size_t size) {
+#ifdef BITMAP_HAVE_X86_SIMD
+    if (hasPopcntDQ()) return popcountAVX512(p, size);
+    if (simdLevel() == SIMD_AVX512BW) return popcountAVX512BW(p, size);
+    if (simdLevel() == SIMD_AVX2) return popcountAVX2(p, size);
+#endif
+    return popcountScalar(p, size);
+}
+
+size_t RedisBitmap::findByteNot(const uint8_t* p, size_t size, uint8_t skip) {
+#ifdef BITMAP_HAVE_X86_SIMD
+    if (simdLevel() == SIMD_AVX512BW) return findByteNotAVX512(p, size, skip);
+    if (simdLevel() == SIMD_AVX2) return findByteNotAVX2(p, size, skip);
+#endif
+    return findByteNotScalar(p, size, skip);
+}
+
+void RedisBitmap::combine(BitOp op, uint8_t* dest, const uint8_t* src, size_t size) {
+#ifdef BITMAP_HAVE_X86_SIMD
+    if (simdLevel() == SIMD_AVX512BW) return combineAVX512(op, dest, src, size);
+    if (simdLevel() == SIMD_AVX2) return combineAVX2(op, dest, src, size);
+#endif
+    combineScalar(op, dest, src, size);
+}
+
+/*
+ * RedisBitmap
+*/
+int RedisBitmap::getBit(const std::string& value, uint64_t offset) {
+    size_t byte = offset >> 3;
+    if (byte >= value.size()) return 0;
+    return (static_cast<uint8_t>(value[byte]) >> (7 - (offset & 7))) & 1;
+}
+
+int RedisBitmap::setBit(std::string& value, uint64_t offset, int bit) {
+    size_t byte = offset >> 3;
+    // std::string grows its capacity geometrically, so a bitmap filled
+    // with increasing offsets is not copied at every SETBIT
+    if (byte >= value.size()) value.resize(byte + 1, '\0');
+    uint8_t mask = 1 << (7 - (offset & 7));
+    uint8_t& target = reinterpret_cast<uint8_t&>(value[byte]);
+    int old = (target & mask) != 0;
+    if (bit) target |= mask;
+    else target &= ~mask;
+    return old;
+}
+
+bool RedisBitmap::resolveRange(size_t size, long long start, long long end, bool bitUnit,
+                               uint64_t& firstBit, uint64_t& lastBit) {
+    long long total = bitUnit ? static_cast<long long>(size) * 8 : static_cast<long long>(size);
+    if (start < 0) start += total;
+    if (end < 0) end += total;
+    if (start < 0) start = 0;
+    if (end < 0) end = 0;
+    if (end >= total) end = total - 1;
+    if (total == 0 || start > end) return false;
+    firstBit = bitUnit ? start : start * 8;
+    lastBit = bitUnit ? end : end * 8 + 7;
+    return true;
+}
+
+uint64_t RedisBitmap::count(const std::string& value, uint64_t firstBit, uint64_t lastBit) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(value.data());
+    size_t first = firstBit >> 3, last = lastBit >> 3;
+    uint8_t head = 0xff >> (firstBit & 7);
+    uint8_t tail = 0xff << (7 - (lastBit & 7));
+    if (first == last) return __builtin_popcount(p[first] & head & tail);
+    return __builtin_popcount(p[first] & head) + popcount(p + first + 1, last - first - 1) +
+        __builtin_popcount(p[last] & tail);
+}
+
+// first bit equal to bit among the mask bits of byte, -1 if none
+static int bitInByte(uint8_t byte, int bit, uint8_t mask) {
+    uint8_t candidates = (bit ? byte : static_cast<uint8_t>(~byte)) & mask;
+    return candidates ? __builtin_clz(candidates) - 24 : -1;
+}
+
+long long RedisBitmap::position(const std::string& value, int bit, uint64_t firstBit, uint64_t lastBit) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(value.data());
+    size_t first = firstBit >> 3, last = lastBit >> 3;
+    uint8_t head = 0xff >> (firstBit & 7);
+    uint8_t tail = 0xff << (7 - (lastBit & 7));
+    if (first == last) {
+        int found = bitInByte(p[first], bit, head & tail);
+        return found < 0 ? -1 : first * 8 + found;
+    }
+    int found = bitInByte(p[first], bit, head);
+    if (found >= 0) return first * 8 + found;
+    size_t middle = first + 1 + findByteNot(p + first + 1, last - first - 1, bit ? 0x00 : 0xff);
+    if (middle < last) return middle * 8 + bitInByte(p[middle], bit, 0xff);
+    found = bitInByte(p[last], bit, tail);
+    return found < 0 ? -1 : last * 8 + found;
+}
+
+void RedisBitmap::bitop(BitOp op, const std::string* const* sources, size_t count, std::string& dest) {
+    if (op == BITOP_NOT) {
+        // single source
+        dest.resize(sources[0]->size());
+        combine(BITOP_NOT, reinterpret_cast<uint8_t*>(&dest[0]), reinterpret_cast<const uint8_t*>(sources[0]->data()),
+                dest.size());
+        return;
+    }
+    size_t size = 0;
+    for (size_t i = 0; i < count; i++) size = std::max(size, sources[i]->size());
+    dest = *sources[0];
+    dest.resize(size, '\0');
+    uint8_t* out = reinterpret_cast<uint8_t*>(&dest[0]);
+    for (size_t i = 1; i < count; i++) {
+        const std::string& src = *sources[i];
+        combine(op, out, reinterpret_cast<const uint8_t*>(src.data()), src.size());
+        // missing bytes are zeros
+        if (op == BITOP_AND) memset(out + src.size(), 0, size - src.size());
+    }
+}
+
+/*
+ * BITFIELD
+*/
+uint64_t RedisBitmap::getField(const std::string& value, uint64_t offset, int bits) {
+    uint64_t field = 0;
+    for (int i = 0; i < bits; i++) field = (field << 1) | getBit(value, offset + i);
+    return field;
+}
+
+void RedisBitmap::setField(std::string& value, uint64_t offset, int bits, uint64_t field) {
+    for (int i = 0; i < bits; i++) setBit(value, offset + i, (field >> (bits - 1 - i)) & 1);
+}
+
+static int64_t signExtend(uint64_t field, int bits) {
+    if (bits == 64 || !(field & (1ULL << (bits - 1)))) return static_cast<int64_t>(field);
+    return static_cast<int64_t>(field | (~0ULL << bits));
+}
+
+bool RedisBitmap::bitfield(std::string& value, const BitfieldOp& op, int64_t& result) {
+    uint64_t field = getField(value, op.offset, op.bits);
+    int64_t current = op.isSigned ? signExtend(field, op.bits) : static_cast<int64_t>(field);
+    if (op.kind == BitfieldOp::GET) {
+        result = current;
+        return true;
+    }
+
+    __int128 min, max;
+    if (op.isSigned) {
+        min = -(static_cast<__int128>(1) << (op.bits - 1));
+        max = (static_cast<__int128>(1) << (op.bits - 1)) - 1;
+    } else {
+        min = 0;
+        max = (static_cast<__int128>(1) << op.bits) - 1;
+    }
+    // as in Redis, an unsigned SET value is taken as unsigned: -1 overflows
+    __int128 wanted;
+    if (op.kind == BitfieldOp::SET) {
+        wanted = op.isSigned ? static_cast<__int128>(op.value) : static_cast<__int128>(static_cast<uint64_t>(op.value));
+    } else {
+        wanted = static_cast<__int128>(current) + op.value;
+    }
+
+    uint64_t mask = op.bits == 64 ? ~0ULL : (1ULL << op.bits) - 1;
+    uint64_t next;
+    if (wanted < min || wanted > max) {
+        if (op.overflow == BITFIELD_FAIL) return false;
+        if (op.overflow == BITFIELD_SAT) next = static_cast<uint64_t>(wanted < min ? min : max) & mask;
+        else next = static_cast<uint64_t>(wanted) & mask;
+    } else {
+        next = static_cast<uint64_t>(wanted) & mask;
+    }
+    setField(value, op.offset, op.bits, next);
+    if (op.kind == BitfieldOp::SET) result = current;
+    else result = op.isSigned ? signExtend(next, op.bits) : static_cast<int64_t>(next);
+    return true;
+}
@@ -0,0 +1,146 @@
+#include "../include/RedisClient.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Output buffer hard limit for push() traffic (pub/sub messages, tracking
+// invalidations): a subscriber that falls this far behind is disconnected
+// instead of growing without bound. Replies to the client's own commands are
+// not limited, they are bounded by the command.
+static const size_t REDIS_CLIENT_PUSH_OUTPUT_LIMIT = 32 * 1024 * 1024;
+static const int REDIS_CLIENT_MAX_IOV = 64;
+
+static std::atomic<uint64_t> next_client_id(1);
+
+RedisClient::RedisClient(int fd)
+    : socket_fd(fd), client_id(next_client_id++), wake_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), closing(false),
+      out_offset(0), out_bytes(0) {}
+
+RedisClient::~RedisClient() {
+    if (wake_fd != -1) ::close(wake_fd);
+    ::close(socket_fd);
+}
+
+bool RedisClient::write(const std::string& reply) {
+    if (reply.empty()) return !closing;
+    bool wasEmpty;
+    return enqueue(std::make_shared<const std::string>(reply), false, wasEmpty);
+}
+
+bool RedisClient::push(const RedisReply& reply) {
+    bool needsWake;
+    if (!push(reply, needsWake)) return false;
+    if (needsWake) wake();
+    return true;
+}
+
+bool RedisClient::push(const RedisReply& reply, bool& needsWake) {
+    // only the first pending reply needs a wakeup, the connection thread
+    // drains the whole queue once it is running
+    return enqueue(reply, true, needsWake);
+}
+
+void RedisClient::wake() {
+    if (onPendingOutput) {
+        onPendingOutput(*this);
+    } else if (wake_fd != -1) {
+        uint64_t one = 1;
+        ssize_t ignored = ::write(wake_fd, &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+bool RedisClient::enqueue(RedisReply reply, bool limited, bool& wasEmpty) {
+    wasEmpty = false;
+    if (closing) return false;
+    {
+        std::lock_guard<std::mutex> lock(out_mutex);
+        if (limited && out_bytes + reply->size() > REDIS_CLIENT_PUSH_OUTPUT_LIMIT) {
+            closing = true;
+        } else {
+            wasEmpty = out_queue.empty();
+            out_bytes += reply->size();
+            out_queue.push_back(std::move(reply));
+        }
+    }
+    if (closing) {
+        wasEmpty = false;
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool RedisClient::flush() {
+    std::lock_guard<std::mutex> lock(out_mutex);
+    while (!out_queue.empty()) {
+        iovec iov[REDIS_CLIENT_MAX_IOV];
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = fillIov(iov, REDIS_CLIENT_MAX_IOV);
+        ssize_t sent = sendmsg(socket_fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            if (errno == EINTR) continue;
+            closing = true;
+            return false;
+        }
+        consume(sent);
+    }
+    return true;
+}
+
+int RedisClient::prepareOutput(iovec* iov, int maxIov) {
+    std::lock_guard<std::mutex> lock(out_mutex);
+    return fillIov(iov, maxIov);
+}
+
+void RedisClient::consumeOutput(size_t bytes) {
+    std::lock_guard<std::mutex> lock(out_mutex);
+    consume(bytes);
+}
+
+int RedisClient::fillIov(iovec* iov, int maxIov) {
+    int count = 0;
+    size_t offset = out_offset;
+    for (auto it = out_queue.begin(); it != out_queue.end() && count < maxIov; ++it) {
+        iov[count].iov_base = const_cast<char*>((*it)->data()) + offset;
+        iov[count].iov_len = (*it)->size() - offset;
+        offset = 0;
+        count++;
+    }
+    return count;
+}
+
+void RedisClient::consume(size_t bytes) {
+    out_bytes -= bytes;
+    while (bytes > 0 && !out_queue.empty()) {
+        size_t remaining = out_queue.front()->size() - out_offset;
+        if (bytes < remaining) {
+            out_offset += bytes;
+            break;
+        }
+        bytes -= remaining;
+        out_offset = 0;
+        out_queue.pop_front();
+    }
+}
+
+bool RedisClient::hasPendingOutput() {
+    std::lock_guard<std::mutex> lock(out_mutex);
+    return !out_queue.empty();
+}
+
+size_t RedisClient::pendingBytes() {
+    std::lock_guard<std::mutex> lock(out_mutex);
+    return out_bytes;
+}
+
+void RedisClient::close() {
+    closing = true;
+    ::shutdown(socket_fd, SHUT_RDWR);
+}
@@ -0,0 +1,484 @@
+#include "../include/RedisCluster.h"
+#include "../include/RedisDatabase.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <sstream>
+
+static std::string bulk(const std::string& s) {
+    return "$" + std::to_string(s.size()) + "\r\n" + s + "\r\n";
+}
+
+static bool parseSlot(const std::string& s, int& slot) {
+    try {
+        size_t pos;
+        long value = std::stol(s, &pos);
+        if (pos != s.size() || value < 0 || value >= RedisCluster::CLUSTER_SLOTS) return false;
+        slot = static_cast<int>(value);
+        return true;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+// CRC16 XMODEM: polynomial 0x1021, initial value 0
+uint16_t RedisCluster::crc16(const char* buf, size_t len) {
+    static uint16_t table[256];
+    static bool init = [] {
+        for (int i = 0; i < 256; i++) {
+            uint16_t crc = i << 8;
+            for (int bit = 0; bit < 8; bit++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+            table[i] = crc;
+        }
+        return true;
+    }();
+    (void)init;
+    uint16_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc = (crc << 8) ^ table[((crc >> 8) ^ static_cast<unsigned char>(buf[i])) & 0xff];
+    }
+    return crc;
+}
+
+int RedisCluster::keyHashSlot(const std::string& key) {
+    // only the part between the first { and the next } is hashed, if not empty
+    size_t open = key.find('{');
+    if (open != std::string::npos) {
+        size_t close = key.find('}', open + 1);
+        if (close != std::string::npos && close != open + 1) {
+            return crc16(key.data() + open + 1, close - open - 1) & (CLUSTER_SLOTS - 1);
+        }
+    }
+    return crc16(key.data(), key.size()) & (CLUSTER_SLOTS - 1);
+}
+
+RedisCluster& RedisCluster::getInstance() {
+    static RedisCluster instance;
+    return instance;
+}
+
+RedisCluster::RedisCluster() : enabled(false), current_epoch(0), slot_owner(CLUSTER_SLOTS), stopping(false) {}
+
+RedisCluster::~RedisCluster() {
+    stopping = true;
+    if (gossip_thread.joinable()) gossip_thread.join();
+}
+
+void RedisCluster::enable(int port, const std::string& announceHost) {
+    {
+        std::lock_guard<std::mutex> lock(cluster_mutex);
+        if (enabled) return;
+        std::random_device rd;
+        std::mt19937_64 gen(rd());
+        const char* hex = "0123456789abcdef";
+        for (int i = 0; i < 40; i++) my_id += hex[gen() % 16];
+        Node& myself = nodes[my_id];
+        myself.id = my_id;
+        myself.host = announceHost;
+        myself.port = port;
+        myself.connected = true;
+        enabled = true;
+    }
+    RedisDatabase::getInstance().enableSlotIndex();
+    gossip_thread = std::thread(&RedisCluster::gossip, this);
+}
+
+std::string RedisCluster::route(const std::vector<std::string>& keys, bool asking) {
+    if (keys.empty()) return "";
+    int slot = keyHashSlot(keys[0]);
+    for (size_t i = 1; i < keys.size(); i++) {
+        if (keyHashSlot(keys[i]) != slot) return "-CROSSSLOT Keys in request don't hash to the same slot\r\n";
+    }
+
+    std::string host;
+    int port;
+    {
+        std::lock_guard<std::mutex> lock(cluster_mutex);
+        const std::string& owner = slot_owner[slot];
+        if (owner.empty()) return "-CLUSTERDOWN Hash slot not served\r\n";
+        if (owner != my_id) {
+            if (asking && importing.count(slot)) return "";
+            const Node& node = nodes[owner];
+            return "-MOVED " + std::to_string(slot) + " " + node.host + ":" + std::to_string(node.port) + "\r\n";
+        }
+        auto it = migrating.find(slot);
+        if (it == migrating.end()) return "";
+        auto target = nodes.find(it->second);
+        if (target == nodes.end()) return "";
+        host = target->second.host;
+        port = target->second.port;
+    }
+    // migrating: keys still here are served here, missing ones may already
+    // live on the target
+    RedisDatabase& db = RedisDatabase::getInstance();
+    size_t missing = 0;
+    for (const auto& key : keys) {
+        if (!db.exists(key)) missing++;
+    }
+    if (missing == 0) return "";
+    if (missing < keys.size()) return "-TRYAGAIN Multiple keys request during rehashing of slot\r\n";
+    return "-ASK " + std::to_string(slot) + " " + host + ":" + std::to_string(port) + "\r\n";
+}
+
+/*
+ * Node table
+*/
+std::string RedisCluster::nodeLine(const Node& node) {
+    std::ostringstream line;
+    line << node.id << " " << node.host << ":" << node.port << "@" << node.port + 10000 << " "
+         << (node.id == my_id ? "myself,master" : "master") << " - 0 0 " << node.configEpoch << " "
+         << (node.connected ? "connected" : "disconnected");
+    for (const auto& range : slotRanges()) {
+        if (range.second != node.id) continue;
+        line << " " << range.first.first;
+        if (range.first.second != range.first.first) line << "-" << range.first.second;
+    }
+    if (node.id == my_id) {
+        for (const auto& slot : migrating) line << " [" << slot.first << "->-" << slot.second << "]";
+        for (const auto& slot : importing) line << " [" << slot.first << "-<-" << slot.second << "]";
+    }
+    return line.str();
+}
+
+std::string RedisCluster::nodesText() {
+    std::string text;
+    for (const auto& node : nodes) text += nodeLine(node.second) + "\n";
+    return text;
+}
+
+std::vector<std::pair<std::pair<int, int>, std::string>> RedisCluster::slotRanges() {
+    std::vector<std::pair<std::pair<int, int>, std::string>> ranges;
+    for (int slot = 0; slot < CLUSTER_SLOTS; slot++) {
+        const std::string& owner = slot_owner[slot];
+        if (owner.empty()) continue;
+        if (!ranges.empty() && ranges.back().second == owner && ranges.back().first.second == slot - 1) {
+            ranges.back().first.second = slot;
+        } else {
+            ranges.push_back({{slot, slot}, owner});
+        }
+    }
+    return ranges;
+}
+
+void RedisCluster::applyNodeLine(const std::string& line, bool fromSelf) {
+    std::istringstream iss(line);
+    std::vector<std::string> fields;
+    std::string field;
+    while (iss >> field) fields.push_back(field);
+    if (fields.size() < 8 || fields[0] == my_id) return;
+
+    const std::string& id = fields[0];
+    size_t colon = fields[1].rfind(':');
+    if (colon == std::string::npos) return;
+    uint64_t epoch;
+    int port;
+    try {
+        port = std::stoi(fields[1].substr(colon + 1)); // stops at @cport
+        epoch = std::stoull(fields[6]);
+    } catch (const std::exception&) {
+        return;
+    }
+
+    bool known = nodes.count(id) > 0;
+    Node& node = nodes[id];
+    if (!known || fromSelf) {
+        node.id = id;
+        node.host = fields[1].substr(0, colon);
+        node.port = port;
+    }
+    if (!fromSelf) return;
+
+    node.configEpoch = epoch;
+    current_epoch = std::max(current_epoch, epoch);
+    for (size_t i = 8; i < fields.size(); i++) {
+        if (fields[i][0] == '[') continue; // migrating / importing state of the sender
+        int start, end;
+        size_t dash = fields[i].find('-');
+        if (!parseSlot(fields[i].substr(0, dash), start)) continue;
+        if (dash == std::string::npos) end = start;
+        else if (!parseSlot(fields[i].substr(dash + 1), end)) continue;
+        for (int slot = start; slot <= end; slot++) {
+            std::string& owner = slot_owner[slot];
+            if (owner == id) continue;
+            if (!owner.empty() && nodes[owner].configEpoch >= epoch) continue;
+            if (owner == my_id) migrating.erase(slot);
+            if (importing.count(slot)) importing.erase(slot);
+            owner = id;
+        }
+    }
+}
+
+void RedisCluster::applyNodesText(const std::string& text) {
+    std::istringstream iss(text);
+    std::string line;
+    while (std::getline(iss, line)) {
+        applyNodeLine(line, line.find("myself") != std::string::npos);
+    }
+}
+
+// a node taking over a slot without consensus needs an epoch nobody else has used
+void RedisCluster::bumpEpoch() {
+    current_epoch++;
+    nodes[my_id].configEpoch = current_epoch;
+}
+
+/*
+ * Gossip: ping every known node, learn its table from the reply
+*/
+void RedisCluster::gossip() {
+    while (!stopping) {
+        for (int waited = 0; waited < CLUSTER_GOSSIP_INTERVAL_MS && !stopping; waited += 100) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        std::vector<Node> targets;
+        std::string myLine;
+        {
+            std::lock_guard<std::mutex> lock(cluster_mutex);
+            for (const auto& node : nodes) {
+                if (node.first != my_id) targets.push_back(node.second);
+            }
+            myLine = nodeLine(nodes[my_id]);
+        }
+        for (const auto& target : targets) {
+            std::unique_ptr<RedisConnection>& link = links[target.id];
+            if (!link) link.reset(new RedisConnection());
+            RedisConnectionReply reply;
+            bool ok = (link->isConnected() || link->connect(target.host, target.port, CLUSTER_LINK_TIMEOUT_MS)) &&
+                link->command({"CLUSTER", "PING", myLine}, reply) && reply.type == '$';
+            if (!ok) link->close();
+
+            std::lock_guard<std::mutex> lock(cluster_mutex);
+            if (ok) applyNodesText(reply.str);
+            auto it = nodes.find(target.id);
+            if (it != nodes.end()) it->second.connected = ok;
+        }
+    }
+}
+
+std::string RedisCluster::meet(const std::string& host, int port) {
+    RedisConnection conn;
+    if (!conn.connect(host, port, CLUSTER_LINK_TIMEOUT_MS)) {
+        return "-ERR Unable to connect to " + host + ":" + std::to_string(port) + "\r\n";
+    }
+    std::string myLine;
+    {
+        std::lock_guard<std::mutex> lock(cluster_mutex);
+        myLine = nodeLine(nodes[my_id]);
+    }
+    RedisConnectionReply reply;
+    if (!conn.command({"CLUSTER", "PING", myLine}, reply) || reply.type != '$') {
+        return "-ERR " + host + ":" + std::to_string(port) + " is not a cluster node\r\n";
+    }
+    std::lock_guard<std::mutex> lock(cluster_mutex);
+    applyNodesText(reply.str);
+    return "+OK\r\n";
+}
+
+/*
+ * CLUSTER subcommands
+*/
+std::string RedisCluster::setSlot(const std::vector<std::string>& tokens) {
+    // CLUSTER SETSLOT <slot> IMPORTING|MIGRATING|NODE <node-id> | STABLE
+    int slot;
+    if (tokens.size() < 4) return "-ERR wrong number of arguments for 'cluster|setslot' command\r\n";
+    if (!parseSlot(tokens[2], slot)) return "-ERR Invalid or out of range slot\r\n";
+    std::string action = tokens[3];
+    std::transform(action.begin(), action.end(), action.begin(), ::toupper);
+    std::string slotName = std::to_string(slot);
+
+    std::lock_guard<std::mutex> lock(cluster_mutex);
+    if (action == "STABLE") {
+        migrating.erase(slot);
+        importing.erase(slot);
+        return "+OK\r\n";
+    }
+    if (tokens.size() < 5 || (action != "IMPORTING" && action != "MIGRATING" && action != "NODE")) {
+        return "-ERR Invalid CLUSTER SETSLOT action or number of arguments\r\n";
+    }
+    const std::string& id = tokens[4];
+    if (nodes.find(id) == nodes.end()) return "-ERR I don't know about node " + id + "\r\n";
+
+    if (action == "IMPORTING") {
+        if (slot_owner[slot] == my_id) return "-ERR I'm already the owner of hash slot " + slotName + "\r\n";
+        importing[slot] = id;
+    } else if (action == "MIGRATING") {
+        if (slot_owner[slot] != my_id) return "-ERR I'm not the owner of hash slot " + slotName + "\r\n";
+        migrating[slot] = id;
+    } else {
+        if (slot_owner[slot] == my_id && id != my_id &&
+            RedisDatabase::getInstance().countKeysInSlot(slot) > 0) {
+            return "-ERR Can't assign hashslot " + slotName +
+                " to a different node while I still hold keys for this hash slot.\r\n";
+        }
+        if (id == my_id && importing.erase(slot)) bumpEpoch();
+        if (id != my_id) migrating.erase(slot);
+        slot_owner[slot] = id;
+    }
+    return "+OK\r\n";
+}
+
+std::string RedisCluster::command(const std::vector<std::string>& tokens) {
+    if (tokens.size() < 2) return "-ERR wrong number of arguments for 'cluster' command\r\n";
+    std::string sub = tokens[1];
+    std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+    RedisDatabase& db = RedisDatabase::getInstance();
+
+    if (sub == "KEYSLOT") {
+        if (tokens.size() != 3) return "-ERR wrong number of arguments for 'cluster|keyslot' command\r\n";
+        return ":" + std::to_string(keyHashSlot(tokens[2])) + "\r\n";
+    } else if (sub == "COUNTKEYSINSLOT") {
+        int slot;
+        if (tokens.size() != 3) return "-ERR wrong number of arguments for 'cluster|countkeysinslot' command\r\n";
+        if (!parseSlot(tokens[2], slot)) return "-ERR Invalid slot\r\n";
+        return ":" + std::to_string(db.countKeysInSlot(slot)) + "\r\n";
+    } else if (sub == "GETKEYSINSLOT") {
+        int slot;
+        if (tokens.size() != 4) return "-ERR wrong number of arguments for 'cluster|getkeysinslot' command\r\n";
+        if (!parseSlot(tokens[2], slot)) return "-ERR Invalid slot\r\n";
+        long count;
+        try {
+            count = std::stol(tokens[3]);
+        } catch (const std::exception&) {
+            count = -1;
+        }
+        if (count < 0) return "-ERR Invalid number of keys\r\n";
+        std::vector<std::string> keys = db.getKeysInSlot(slot, count);
+        std::string reply = "*" + std::to_string(keys.size()) + "\r\n";
+        for (const auto& key : keys) reply += bulk(key);
+        return reply;
+    } else if (sub == "MEET") {
+        if (tokens.size() < 4) return "-ERR wrong number of arguments for 'cluster|meet' command\r\n";
+        int port;
+        try {
+            port = std::stoi(tokens[3]);
+        } catch (const std::exception&) {
+            return "-ERR Invalid base port specified: " + tokens[3] + "\r\n";
+        }
+        return meet(tokens[2], port);
+    } else if (sub == "SETSLOT") {
+        return setSlot(tokens);
+    }
+
+    std::lock_guard<std::mutex> lock(cluster_mutex);
+    if (sub == "MYID") {
+        return bulk(my_id);
+    } else if (sub == "PING") {
+        // CLUSTER PING <sender's own node line>, sent by the gossip thread
+        if (tokens.size() != 3) return "-ERR wrong number of arguments for 'cluster|ping' command\r\n";
+        applyNodeLine(tokens[2], true);
+        return bulk(nodesText());
+    } else if (sub == "NODES") {
+        return bulk(nodesText());
+    } else if (sub == "ADDSLOTS" || sub == "ADDSLOTSRANGE") {
+        bool range = sub == "ADDSLOTSRANGE";
+        if (tokens.size() < 3 || (range && tokens.size() % 2 != 0)) {
+            return "-ERR wrong number of arguments for 'cluster|" + std::string(range ? "addslotsrange" : "addslots") +
+                "' command\r\n";
+        }
+        std::vector<int> slots;
+        for (size_t i = 2; i < tokens.size(); i += range ? 2 : 1) {
+            int start, end;
+            if (!parseSlot(tokens[i], start)) return "-ERR Invalid or out of range slot\r\n";
+            end = start;
+            if (range && !parseSlot(tokens[i + 1], end)) return "-ERR Invalid or out of range slot\r\n";
+            if (end < start) return "-ERR start slot number " + tokens[i] + " is greater than end slot number\r\n";
+            for (int slot = start; slot <= end; slot++) {
+                if (!slot_owner[slot].empty()) return "-ERR Slot " + std::to_string(slot) + " is already busy\r\n";
+                slots.push_back(slot);
+            }
+        }
+        for (int slot : slots) slot_owner[slot] = my_id;
+        return "+OK\r\n";
+    } else if (sub == "SLOTS") {
+        // *<ranges> of [start, end, [host, port, id]]
+        auto ranges = slotRanges();
+        std::string reply = "*" + std::to_string(ranges.size()) + "\r\n";
+        for (const auto& range : ranges) {
+            const Node& node = nodes[range.second];
+            reply += "*3\r\n:" + std::to_string(range.first.first) + "\r\n:" + std::to_string(range.first.second) +
+                "\r\n*3\r\n" + bulk(node.host) + ":" + std::to_string(node.port) + "\r\n" + bulk(node.id);
+        }
+        return reply;
+    } else if (sub == "SHARDS") {
+        // one shard per node (no replicas): slots as [start, end, ...] and the node description
+        auto ranges = slotRanges();
+        std::string reply = "*" + std::to_string(nodes.size()) + "\r\n";
+        for (const auto& entry : nodes) {
+            const Node& node = entry.second;
+            std::string slots;
+            size_t count = 0;
+            for (const auto& range : ranges) {
+                if (range.second != node.id) continue;
+                slots += ":" + std::to_string(range.first.first) + "\r\n:" + std::to_string(range.first.second) + "\r\n";
+                count += 2;
+            }
+            reply += "*4\r\n" + bulk("slots") + "*" + std::to_string(count) + "\r\n" + slots;
+            reply += bulk("nodes") + "*1\r\n*14\r\n";
+            reply += bulk("id") + bulk(node.id);
+            reply += bulk("port") + ":" + std::to_string(node.port) + "\r\n";
+            reply += bulk("ip") + bulk(node.host);
+            reply += bulk("endpoint") + bulk(node.host);
+            reply += bulk("role") + bulk("master");
+            reply += bulk("replication-offset") + ":0\r\n";
+            reply += bulk("health") + bulk(node.connected ? "online" : "failed");
+        }
+        return reply;
+    } else if (sub == "INFO") {
+        size_t assigned = CLUSTER_SLOTS - std::count(slot_owner.begin(), slot_owner.end(), std::string());
+        size_t size = 0;
+        for (const auto& node : nodes) {
+            if (std::find(slot_owner.begin(), slot_owner.end(), node.first) != slot_owner.end()) size++;
+        }
+        std::ostringstream info;
+        info << "cluster_state:" << (assigned == CLUSTER_SLOTS ? "ok" : "fail") << "\r\n"
+             << "cluster_slots_assigned:" << assigned << "\r\n"
+             << "cluster_known_nodes:" << nodes.size() << "\r\n"
+             << "cluster_size:" << size << "\r\n"
+             << "cluster_current_epoch:" << current_epoch << "\r\n"
+             << "cluster_my_epoch:" << nodes[my_id].configEpoch << "\r\n";
+        return bulk(info.str());
+    }
+    return "-ERR unknown subcommand '" + tokens[1] + "'\r\n";
+}
+
+/*
+ * MIGRATE
+*/
+std::string RedisCluster::migrate(const std::string& host, int port, const std::vector<std::string>& keys,
+                                  int timeoutMs, bool copy, bool replace) {
+    // keys are sent in pipelined batches: one write and one round trip per batch
+    static const size_t MIGRATE_BATCH = 100;
+    RedisDatabase& db = RedisDatabase::getInstance();
+    RedisConnection conn;
+    if (!conn.connect(host, port, timeoutMs)) return "-IOERR error or timeout connecting to the client\r\n";
+
+    size_t moved = 0;
+    std::vector<std::string> changed;
+    for (size_t begin = 0; begin < keys.size(); begin += MIGRATE_BATCH) {
+        // key, payload sent
+        std::vector<std::pair<std::string, std::string>> batch;
+        for (size_t i = begin; i < keys.size() && i < begin + MIGRATE_BATCH; i++) {
+            std::string payload;
+            long long ttl;
+            if (!db.dumpKey(keys[i], payload, ttl)) continue;
+            std::vector<std::string> args = {"RESTORE-ASKING", keys[i], std::to_string(ttl), payload};
+            if (replace) args.push_back("REPLACE");
+            conn.append(args);
+            batch.emplace_back(keys[i], std::move(payload));
+        }
+        for (const auto& sent : batch) {
+            RedisConnectionReply reply;
+            if (!conn.readReply(reply)) return "-IOERR error or timeout reading to target instance\r\n";
+            if (reply.type == '-') return "-ERR Target instance replied with error: " + reply.str + "\r\n";
+            // a write that landed after the dump must not be lost: keep the key here
+            if (!copy && !db.unlinkIfUnchanged(sent.first, sent.second)) changed.push_back(sent.first);
+        }
+        moved += batch.size();
+    }
+    if (!changed.empty()) {
+        return "-TRYAGAIN " + std::to_string(changed.size()) + " key(s) changed during MIGRATE, first '" +
+            changed[0] + "', retry with REPLACE\r\n";
+    }
+    return moved == 0 ? "+NOKEY\r\n" : "+OK\r\n";
+}
@@ -1,8 +1,20 @@
 
 #include "../include/RedisCommandHandler.h"
+#include "../include/RedisBigKeys.h"
+#include "../include/RedisCluster.h"
+#include "../include/RedisCompression.h"
 #include "../include/RedisDatabase.h"
+#include "../include/RedisEpoch.h"
+#include "../include/RedisHotKeys.h"
+#include "../include/RedisLazyFree.h"
+#include "../include/RedisPubSub.h"
+#include "../include/RedisReadCache.h"
+#include "../include/RedisTracking.h"
 
 #include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
 #include <vector>
 #include <sstream>
 
@@ -54,9 +66,469 @@ std::vector<std::string> parseRespCommand(const std::string& input) {
     return tokens;
 }
 
+// Length of the command starting at pos, 0 if it has not been fully received yet.
+// Multibulk: *<n>\r\n followed by n times $<len>\r\n<data>\r\n
+// Inline: everything up to the next \n
+static size_t commandLength(const std::string& input, size_t pos) {
+    if (input[pos] != '*') {
+        size_t nl = input.find('\n', pos);
+        return nl == std::string::npos ? 0 : nl - pos + 1;
+    }
+    size_t crlf = input.find("\r\n", pos);
+    if (crlf == std::string::npos) return 0;
+    long numElements = strtol(input.c_str() + pos + 1, nullptr, 10);
+    size_t cur = crlf + 2;
+    for (long i = 0; i < numElements; i++) {
+        if (cur >= input.size()) return 0;
+        // malformed: hand the rest to processCommand, which reports the error
+        if (input[cur] != '$') return input.size() - pos;
+        crlf = input.find("\r\n", cur);
+        if (crlf == std::string::npos) return 0;
+        long len = strtol(input.c_str() + cur + 1, nullptr, 10);
+        if (len < 0) return input.size() - pos;
+        cur = crlf + 2 + len + 2;
+        if (cur > input.size()) return 0;
+    }
+    return cur - pos;
+}
+
 RedisCommandHandler::RedisCommandHandler() {}
 
-std::string RedisCommandHandler::processCommand(const std::string &commandLine) {
+std::string RedisCommandHandler::processBuffer(RedisClient& client) {
+    std::string& buffer = client.query_buffer;
+    std::string replies;
+    size_t pos = 0;
+    while (pos < buffer.size() && !client.isClosing() && !client.close_after_reply) {
+        size_t len = commandLength(buffer, pos);
+        if (len == 0) break;
+        std::string command = buffer.substr(pos, len);
+        pos += len;
+        // empty inline lines are ignored, as in redis
+        if (command == "\r\n" || command == "\n") continue;
+        replies += processCommand(command, client);
+    }
+    buffer.erase(0, pos);
+    return replies;
+}
+
+// Keys a command touches, used for cluster routing
+static std::vector<std::string> commandKeys(const std::string& cmd, const std::vector<std::string>& tokens) {
+    if (cmd == "PING" || cmd == "ECHO" || cmd == "FLUSHALL" || cmd == "KEYS" || cmd == "SUBSCRIBE" ||
+        cmd == "UNSUBSCRIBE" || cmd == "PSUBSCRIBE" || cmd == "PUNSUBSCRIBE" || cmd == "PUBLISH" ||
+        cmd == "QUIT" || cmd == "CLUSTER" || cmd == "ASKING" || cmd == "MIGRATE" || cmd == "CLIENT" ||
+        cmd == "HELLO" || cmd == "HOTKEYS" || cmd == "BIGKEYS" || cmd == "INFO") {
+        return {};
+    }
+    if (cmd == "MEMORY") {
+        if (tokens.size() >= 3) return {tokens[2]};
+        return {};
+    }
+    if (cmd == "DEL" || cmd == "UNLINK" || cmd == "EXISTS" || cmd == "PFCOUNT" ||
+        cmd == "PFMERGE") {
+        return std::vector<std::string>(tokens.begin() + 1, tokens.end());
+    }
+    if (cmd == "RENAME" && tokens.size() >= 3) return {tokens[1], tokens[2]};
+    if (cmd == "BITOP" && tokens.size() >= 3) return std::vector<std::string>(tokens.begin() + 2, tokens.end());
+    if (tokens.size() >= 2) return {tokens[1]};
+    return {};
+}
+
+// Commands whose keys a tracking client may cache
+static bool isReadOnlyCommand(const std::string& cmd) {
+    return cmd == "GET" || cmd == "EXISTS" || cmd == "TYPE" || cmd == "LLEN" || cmd == "LINDEX" ||
+        cmd == "HGET" || cmd == "HEXISTS" || cmd == "HGETALL" || cmd == "HKEYS" || cmd == "HVALS" ||
+        cmd == "HLEN" || cmd == "ZSCORE" || cmd == "ZCARD" || cmd == "ZRANK" || cmd == "ZREVRANK" ||
+        cmd == "ZCOUNT" || cmd == "ZRANGE" || cmd == "DUMP" || cmd == "GETBIT" || cmd == "BITCOUNT" ||
+        cmd == "BITPOS" || cmd == "BITFIELD_RO";
+}
+
+// CLIENT ID | CLIENT TRACKING ON|OFF [REDIRECT id] [BCAST] [PREFIX prefix ...]
+static std::string clientCommand(const std::vector<std::string>& tokens, RedisClient& client) {
+    if (tokens.size() < 2) return "-ERR wrong number of arguments for 'client' command\r\n";
+    std::string sub = tokens[1];
+    std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+    RedisTracking& tracking = RedisTracking::getInstance();
+    if (sub == "ID") {
+        return ":" + std::to_string(client.id()) + "\r\n";
+    } else if (sub == "TRACKING") {
+        if (tokens.size() < 3) return "-ERR wrong number of arguments for 'client|tracking' command\r\n";
+        std::string mode = tokens[2];
+        std::transform(mode.begin(), mode.end(), mode.begin(), ::toupper);
+        if (mode == "OFF") return tracking.disable(client);
+        if (mode != "ON") return "-ERR syntax error\r\n";
+        uint64_t redirect = 0;
+        bool bcast = false;
+        std::vector<std::string> prefixes;
+        for (size_t i = 3; i < tokens.size(); i++) {
+            std::string option = tokens[i];
+            std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+            if (option == "BCAST") {
+                bcast = true;
+            } else if (option == "REDIRECT" && i + 1 < tokens.size()) {
+                try {
+                    redirect = std::stoull(tokens[++i]);
+                } catch (const std::exception&) {
+                    return "-ERR value is not an integer or out of range\r\n";
+                }
+            } else if (option == "PREFIX" && i + 1 < tokens.size()) {
+                prefixes.push_back(tokens[++i]);
+            } else {
+                return "-ERR syntax error\r\n";
+            }
+        }
+        return tracking.enable(client, redirect, bcast, prefixes);
+    }
+    return "-ERR unknown subcommand '" + tokens[1] + "'\r\n";
+}
+
+// HELLO [protover]: switch protocol and describe the server
+static std::string helloCommand(const std::vector<std::string>& tokens, RedisClient& client) {
+    if (tokens.size() >= 2) {
+        if (tokens[1] != "2" && tokens[1] != "3") return "-NOPROTO unsupported protocol version\r\n";
+        client.resp = tokens[1] == "3" ? 3 : 2;
+    }
+    // RESP3 map, flattened to an array for RESP2
+    std::string reply = client.resp == 3 ? "%6\r\n" : "*12\r\n";
+    reply += "$6\r\nserver\r\n$5\r\nredis\r\n";
+    reply += "$7\r\nversion\r\n$5\r\n7.0.0\r\n";
+    reply += "$5\r\nproto\r\n:" + std::to_string(client.resp) + "\r\n";
+    reply += "$2\r\nid\r\n:" + std::to_string(client.id()) + "\r\n";
+    reply += "$4\r\nmode\r\n";
+    reply += RedisCluster::getInstance().isEnabled() ? "$7\r\ncluster\r\n" : "$10\r\nstandalone\r\n";
+    reply += "$4\r\nrole\r\n$6\r\nmaster\r\n";
+    return reply;
+}
+
+// RESTORE key ttl payload [REPLACE]
+static std::string restoreCommand(const std::vector<std::string>& tokens) {
+    if (tokens.size() < 4) return "-ERR wrong number of arguments for 'restore' command\r\n";
+    long long ttl;
+    try {
+        ttl = std::stoll(tokens[2]);
+    } catch (const std::exception&) {
+        return "-ERR value is not an integer or out of range\r\n";
+    }
+    if (ttl < 0) return "-ERR Invalid TTL value, must be >= 0\r\n";
+    bool replace = false;
+    for (size_t i = 4; i < tokens.size(); i++) {
+        std::string option = tokens[i];
+        std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+        if (option != "REPLACE") return "-ERR syntax error\r\n";
+        replace = true;
+    }
+    std::string error;
+    if (!RedisDatabase::getInstance().restoreKey(tokens[1], tokens[3], ttl, replace, error)) return error + "\r\n";
+    return "+OK\r\n";
+}
+
+// MIGRATE host port key|"" destination-db timeout [COPY] [REPLACE] [KEYS key ...]
+static std::string migrateCommand(const std::vector<std::string>& tokens) {
+    if (tokens.size() < 6) return "-ERR wrong number of arguments for 'migrate' command\r\n";
+    int port, timeout;
+    try {
+        port = std::stoi(tokens[2]);
+        timeout = std::stoi(tokens[5]);
+    } catch (const std::exception&) {
+        return "-ERR value is not an integer or out of range\r\n";
+    }
+    if (tokens[4] != "0") return "-ERR only database 0 is supported\r\n";
+    if (timeout <= 0) timeout = 1000;
+    bool copy = false, replace = false;
+    std::vector<std::string> keys;
+    if (!tokens[3].empty()) keys.push_back(tokens[3]);
+    for (size_t i = 6; i < tokens.size(); i++) {
+        std::string option = tokens[i];
+        std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+        if (option == "COPY") {
+            copy = true;
+        } else if (option == "REPLACE") {
+            replace = true;
+        } else if (option == "KEYS") {
+            if (!tokens[3].empty()) {
+                return "-ERR When using MIGRATE KEYS option, the key argument must be set to the empty string\r\n";
+            }
+            keys.assign(tokens.begin() + i + 1, tokens.end());
+            break;
+        } else {
+            return "-ERR syntax error\r\n";
+        }
+    }
+    return RedisCluster::migrate(tokens[1], port, keys, timeout, copy, replace);
+}
+
+// SETBIT / GETBIT / BITFIELD offsets: strings are capped at 512MB
+static bool parseBitOffset(const std::string& token, uint64_t& offset) {
+    try {
+        size_t end;
+        long long value = std::stoll(token, &end);
+        if (end != token.size() || value < 0 || static_cast<uint64_t>(value) > RedisBitmap::MAX_BIT_OFFSET) {
+            return false;
+        }
+        offset = value;
+        return true;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+// trailing BYTE | BIT of BITCOUNT / BITPOS ranges
+static bool parseBitUnit(const std::string& token, bool& bitUnit) {
+    std::string unit = token;
+    std::transform(unit.begin(), unit.end(), unit.begin(), ::toupper);
+    if (unit != "BYTE" && unit != "BIT") return false;
+    bitUnit = unit == "BIT";
+    return true;
+}
+
+// BITCOUNT key [start end [BYTE|BIT]]
+static std::string bitcountCommand(const std::vector<std::string>& tokens) {
+    if (tokens.size() < 2) return "-ERR wrong number of arguments for 'bitcount' command\r\n";
+    if (tokens.size() == 3 || tokens.size() > 5) return "-ERR syntax error\r\n";
+    long long start = 0, end = -1;
+    bool bitUnit = false;
+    if (tokens.size() >= 4) {
+        try {
+            start = std::stoll(tokens[2]);
+            end = std::stoll(tokens[3]);
+        } catch (const std::exception&) {
+            return "-ERR value is not an integer or out of range\r\n";
+        }
+    }
+    if (tokens.size() == 5 && !parseBitUnit(tokens[4], bitUnit)) return "-ERR syntax error\r\n";
+    return ":" + std::to_string(RedisDatabase::getInstance().bitcount(tokens[1], start, end, bitUnit)) + "\r\n";
+}
+
+// BITPOS key bit [start [end [BYTE|BIT]]]
+static std::string bitposCommand(const std::vector<std::string>& tokens) {
+    if (tokens.size() < 3) return "-ERR wrong number of arguments for 'bitpos' command\r\n";
+    if (tokens.size() > 6) return "-ERR syntax error\r\n";
+    if (tokens[2] != "0" && tokens[2] != "1") return "-ERR The bit argument must be 1 or 0.\r\n";
+    long long start = 0, end = -1;
+    bool bitUnit = false;
+    try {
+        if (tokens.size() >= 4) start = std::stoll(tokens[3]);
+        if (tokens.size() >= 5) end = std::stoll(tokens[4]);
+    } catch (const std::exception&) {
+        return "-ERR value is not an integer or out of range\r\n";
+    }
+    if (tokens.size() == 6 && !parseBitUnit(tokens[5], bitUnit)) return "-ERR syntax error\r\n";
+    long long pos = RedisDatabase::getInstance().bitpos(tokens[1], tokens[2] == "1", start, end, tokens.size() >= 5,
+                                                        bitUnit);
+    return ":" + std::to_string(pos) + "\r\n";
+}
+
+// BITOP AND|OR|XOR|NOT destkey key [key ...]
+static std::string bitopCommand(const std::vector<std::string>& tokens) {
+    if (tokens.size() < 4) return "-ERR wrong number of arguments for 'bitop' command\r\n";
+    std::string name = tokens[1];
+    std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+    BitOp op;
+    if (name == "AND") op = BITOP_AND;
+    else if (name == "OR") op = BITOP_OR;
+    else if (name == "XOR") op = BITOP_XOR;
+    else if (name == "NOT") op = BITOP_NOT;
+    else return "-ERR syntax error\r\n";
+    if (op == BITOP_NOT && tokens.size() != 4) return "-ERR BITOP NOT must be called with a single source key.\r\n";
+    size_t size = RedisDatabase::getInstance().bitop(op, tokens[2],
+                                                     std::vector<std::string>(tokens.begin() + 3, tokens.end()));
+    return ":" + std::to_string(size) + "\r\n";
+}
+
+// BITFIELD key [GET type offset] [SET type offset value] [INCRBY type offset increment]
+//              [OVERFLOW WRAP|SAT|FAIL] ...
+// BITFIELD_RO key [GET type offset] ...
+static std::string bitfieldCommand(const std::vector<std::string>& tokens, bool readOnly) {
+    if (tokens.size() < 2) {
+        return std::string("-ERR wrong number of arguments for '") + (readOnly ? "bitfield_ro" : "bitfield") +
+            "' command\r\n";
+    }
+    std::vector<BitfieldOp> ops;
+    BitfieldOverflow overflow = BITFIELD_WRAP;
+    for (size_t i = 2; i < tokens.size();) {
+        std::string sub = tokens[i];
+        std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+        if (sub == "OVERFLOW" && i + 1 < tokens.size()) {
+            std::string type = tokens[i + 1];
+            std::transform(type.begin(), type.end(), type.begin(), ::toupper);
+            if (type == "WRAP") overflow = BITFIELD_WRAP;
+            else if (type == "SAT") overflow = BITFIELD_SAT;
+            else if (type == "FAIL") overflow = BITFIELD_FAIL;
+            else return "-ERR Invalid OVERFLOW type specified\r\n";
+            i += 2;
+            continue;
+        }
+        BitfieldOp op;
+        size_t args;
+        if (sub == "GET") {
+            op.kind = BitfieldOp::GET;
+            args = 3;
+        } else if (sub == "SET") {
+            op.kind = BitfieldOp::SET;
+            args = 4;
+        } else if (sub == "INCRBY") {
+            op.kind = BitfieldOp::INCRBY;
+            args = 4;
+        } else {
+            return "-ERR syntax error\r\n";
+        }
+        if (i + args > tokens.size()) return "-ERR syntax error\r\n";
+        if (readOnly && op.kind != BitfieldOp::GET) return "-ERR BITFIELD_RO only supports the GET subcommand\r\n";
+
+        // type: i1..i64 or u1..u63
+        const std::string& type = tokens[i + 1];
+        char sign = type.empty() ? 0 : ::tolower(type[0]);
+        op.bits = 0;
+        if ((sign == 'i' || sign == 'u') && type.size() >= 2 && type.size() <= 3 &&
+            std::all_of(type.begin() + 1, type.end(), [](unsigned char c) { return std::isdigit(c); })) {
+            op.bits = std::stoi(type.substr(1));
+        }
+        op.isSigned = sign == 'i';
+        if (op.bits < 1 || op.bits > (op.isSigned ? 64 : 63)) {
+            return "-ERR Invalid bitfield type. Use something like i16 u8. Note that u64 is not supported but i64 is.\r\n";
+        }
+        // offset: bits, or #n for the n-th field of this type
+        std::string offset = tokens[i + 2];
+        bool byField = !offset.empty() && offset[0] == '#';
+        if (!parseBitOffset(byField ? offset.substr(1) : offset, op.offset)) {
+            return "-ERR bit offset is not an integer or out of range\r\n";
+        }
+        if (byField) op.offset *= op.bits;
+        if (op.offset + op.bits - 1 > RedisBitmap::MAX_BIT_OFFSET) {
+            return "-ERR bit offset is not an integer or out of range\r\n";
+        }
+        if (args == 4) {
+            try {
+                size_t end;
+                op.value = std::stoll(tokens[i + 3], &end);
+                if (end != tokens[i + 3].size()) throw std::invalid_argument("value");
+            } catch (const std::exception&) {
+                return "-ERR value is not an integer or out of range\r\n";
+            }
+        }
+        op.overflow = overflow;
+        ops.push_back(op);
+        i += args;
+    }
+
+    auto replies = RedisDatabase::getInstance().bitfield(tokens[1], ops);
+    std::string reply = "*" + std::to_string(replies.size()) + "\r\n";
+    for (const auto& r : replies) reply += r.first ? ":" + std::to_string(r.second) + "\r\n" : "$-1\r\n";
+    return reply;
+}
+
+// INFO [section]; only the memory section so far
+static std::string infoCommand(const std::vector<std::string>& tokens) {
+    if (tokens.size() > 2) return "-ERR syntax error\r\n";
+    std::string section = tokens.size() == 2 ? tokens[1] : "default";
+    std::transform(section.begin(), section.end(), section.begin(), ::tolower);
+    std::ostringstream info;
+    if (section == "memory" || section == "default" || section == "all" || section == "everything") {
+        RedisCompression& compression = RedisCompression::getInstance();
+        long long compressed = compression.compressedBytes(), raw = compression.rawBytes();
+        char ratio[32];
+        snprintf(ratio, sizeof(ratio), "%.2f", compressed > 0 ? double(raw) / compressed : 1.0);
+        info << "# Memory\r\n";
+        info << "lazyfree_pending_objects:" << RedisLazyFree::getInstance().pending() << "\r\n";
+        // strings and list elements currently stored compressed
+        info << "value_compression_threshold:" << compression.threshold() << "\r\n";
+        info << "compressed_values:" << compression.compressedValues() << "\r\n";
+        info << "compressed_values_bytes:" << compressed << "\r\n";
+        info << "compressed_values_raw_bytes:" << raw << "\r\n";
+        info << "compressed_values_ratio:" << ratio << "\r\n";
+        // lock free GET / HGET
+        info << "read_cache_slots:" << RedisReadCache::getInstance().slots() << "\r\n";
+        info << "epoch_retired_pending:" << RedisEpoch::getInstance().pending() << "\r\n";
+    }
+    std::string text = info.str();
+    return "$" + std::to_string(text.size()) + "\r\n" + text + "\r\n";
+}
+
+// MEMORY USAGE key [SAMPLES count]
+static std::string memoryCommand(const std::vector<std::string>& tokens) {
+    if (tokens.size() < 2) return "-ERR wrong number of arguments for 'memory' command\r\n";
+    std::string sub = tokens[1];
+    std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+    if (sub != "USAGE") return "-ERR unknown subcommand '" + tokens[1] + "'. Try MEMORY USAGE.\r\n";
+    if (tokens.size() != 3 && tokens.size() != 5) return "-ERR wrong number of arguments for 'memory|usage' command\r\n";
+    long long samples = 5;
+    if (tokens.size() == 5) {
+        std::string option = tokens[3];
+        std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+        if (option != "SAMPLES") return "-ERR syntax error\r\n";
+        try {
+            samples = std::stoll(tokens[4]);
+        } catch (const std::exception&) {
+            return "-ERR value is not an integer or out of range\r\n";
+        }
+        if (samples < 0) return "-ERR value is not an integer or out of range\r\n";
+    }
+    long long bytes = RedisDatabase::getInstance().memoryUsage(tokens[2], samples);
+    if (bytes < 0) return "$-1\r\n";
+    return ":" + std::to_string(bytes) + "\r\n";
+}
+
+// HOTKEYS [COUNT count]: key, accesses per second, hottest first
+static std::string hotkeysCommand(const std::vector<std::string>& tokens) {
+    long long count = 10;
+    if (tokens.size() == 3) {
+        std::string option = tokens[1];
+        std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+        if (option != "COUNT") return "-ERR syntax error\r\n";
+        try {
+            count = std::stoll(tokens[2]);
+        } catch (const std::exception&) {
+            return "-ERR value is not an integer or out of range\r\n";
+        }
+        if (count < 1 || count > static_cast<long long>(RedisHotKeys::HOTKEYS_MAX_COUNT)) {
+            return "-ERR COUNT must be between 1 and " + std::to_string(RedisHotKeys::HOTKEYS_MAX_COUNT) + "\r\n";
+        }
+    } else if (tokens.size() != 1) {
+        return "-ERR syntax error\r\n";
+    }
+    // candidates can be keys deleted since they were hot
+    RedisDatabase& db = RedisDatabase::getInstance();
+    std::vector<std::pair<std::string, uint64_t>> keys;
+    for (auto& key : RedisHotKeys::getInstance().top(RedisHotKeys::HOTKEYS_MAX_COUNT)) {
+        if (keys.size() == static_cast<size_t>(count)) break;
+        if (db.exists(key.first)) keys.push_back(std::move(key));
+    }
+    std::string reply = "*" + std::to_string(keys.size() * 2) + "\r\n";
+    for (const auto& key : keys) {
+        reply += "$" + std::to_string(key.first.size()) + "\r\n" + key.first + "\r\n";
+        reply += ":" + std::to_string(key.second) + "\r\n";
+    }
+    return reply;
+}
+
+// BIGKEYS [REPORT] | BIGKEYS START [COUNT count]
+static std::string bigkeysCommand(const std::vector<std::string>& tokens) {
+    RedisBigKeys& bigkeys = RedisBigKeys::getInstance();
+    std::string sub = tokens.size() > 1 ? tokens[1] : "REPORT";
+    std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+    if (sub == "REPORT" && tokens.size() <= 2) {
+        std::string report = bigkeys.report();
+        return "$" + std::to_string(report.size()) + "\r\n" + report + "\r\n";
+    }
+    if (sub != "START" || (tokens.size() != 2 && tokens.size() != 4)) return "-ERR syntax error\r\n";
+    long long count = RedisBigKeys::DEFAULT_TOP;
+    if (tokens.size() == 4) {
+        std::string option = tokens[2];
+        std::transform(option.begin(), option.end(), option.begin(), ::toupper);
+        if (option != "COUNT") return "-ERR syntax error\r\n";
+        try {
+            count = std::stoll(tokens[3]);
+        } catch (const std::exception&) {
+            return "-ERR value is not an integer or out of range\r\n";
+        }
+        if (count < 1 || count > static_cast<long long>(RedisBigKeys::MAX_TOP)) {
+            return "-ERR COUNT must be between 1 and " + std::to_string(RedisBigKeys::MAX_TOP) + "\r\n";
+        }
+    }
+    if (!bigkeys.start(count)) return "-ERR a big key scan is already running\r\n";
+    return "+OK\r\n";
+}
+
+std::string RedisCommandHandler::processCommand(const std::string &commandLine, RedisClient& client) {
     // use RESP parser:
     auto tokens = parseRespCommand(commandLine);
     if (tokens.empty()) return "ERR: empty command\r\n";
@@ -66,6 +538,31 @@ std::string RedisCommandHandler::processCommand(const std::string &commandLine)
     std::ostringstream response;
 
     RedisDatabase& db = RedisDatabase::getInstance();
+    RedisPubSub& pubsub = RedisPubSub::getInstance();
+
+    // a subscribed client can only manage its subscriptions
+    if (client.subscriptionCount() > 0 && cmd != "SUBSCRIBE" && cmd != "UNSUBSCRIBE" &&
+        cmd != "PSUBSCRIBE" && cmd != "PUNSUBSCRIBE" && cmd != "PING" && cmd != "QUIT") {
+        return "-ERR only (P)SUBSCRIBE / (P)UNSUBSCRIBE / PING / QUIT allowed in this context\r\n";
+    }
+
+    // ASKING only applies to the command that follows it
+    bool asking = client.asking || cmd == "RESTORE-ASKING";
+    client.asking = false;
+    RedisCluster& cluster = RedisCluster::getInstance();
+    if (cluster.isEnabled()) {
+        std::string redirect = cluster.route(commandKeys(cmd, tokens), asking);
+        if (!redirect.empty()) return redirect;
+    }
+
+    RedisHotKeys& hotkeys = RedisHotKeys::getInstance();
+    if (hotkeys.sample()) hotkeys.record(commandKeys(cmd, tokens));
+
+    // remember the keys before reading them, so a write racing with the read
+    // still sends its invalidation
+    if (client.tracking && !client.tracking_bcast && isReadOnlyCommand(cmd)) {
+        RedisTracking::getInstance().rememberKeys(client, commandKeys(cmd, tokens));
+    }
 
     // check commands
     if (cmd == "PING") {
@@ -77,8 +574,14 @@ std::string RedisCommandHandler::processCommand(const std::string &commandLine)
             response << "+" << tokens[1] << "\r\n";
         }
     } else if (cmd == "FLUSHALL") {
-        db.flushAll();
-        response << "+OK\r\n";
+        std::string mode = tokens.size() >= 2 ? tokens[1] : "SYNC";
+        std::transform(mode.begin(), mode.end(), mode.begin(), ::toupper);
+        if (mode != "SYNC" && mode != "ASYNC") {
+            response << "-ERR syntax error\r\n";
+        } else {
+            db.flushAll(mode == "ASYNC");
+            response << "+OK\r\n";
+        }
     } else if (cmd == "SET") {
         if (tokens.size() < 3) {
             response << "-ERR wrong number of arguments for 'set' command\r\n";
@@ -114,8 +617,23 @@ std::string RedisCommandHandler::processCommand(const std::string &commandLine)
         if (tokens.size() < 2) {
             response << "-ERR wrong number of arguments for " << cmd << "  command\r\n";
         } else {
-            bool res = db.del(tokens[1]);
-            response << ":" << (res ? 1 : 0) << "\r\n";
+            // UNLINK detaches the keys now and frees big values in the background
+            int removed = 0;
+            for (size_t i = 1; i < tokens.size(); i++) {
+                bool res = cmd == "UNLINK" ? db.unlink(tokens[i]) : db.del(tokens[i]);
+                if (res) removed++;
+            }
+            response << ":" << removed << "\r\n";
+        }
+    } else if (cmd == "EXISTS") {
+        if (tokens.size() < 2) {
+            response << "-ERR wrong number of arguments for 'exists' command\r\n";
+        } else {
+            int found = 0;
+            for (size_t i = 1; i < tokens.size(); i++) {
+                if (db.exists(tokens[i])) found++;
+            }
+            response << ":" << found << "\r\n";
         }
     } else if (cmd == "EXPIRE") {
         if (tokens.size() < 3) {
@@ -304,6 +822,309 @@ std::string RedisCommandHandler::processCommand(const std::string &commandLine)
             response << "+OK\r\n";
         }
     }
+    //sorted set operations
+    else if (cmd == "ZADD") {
+        // ZADD key [NX|XX] [GT|LT] [CH] [INCR] score member [score member ...]
+        int flags = 0;
+        bool ch = false;
+        size_t i = 2;
+        for (; i < tokens.size(); i++) {
+            std::string opt = tokens[i];
+            std::transform(opt.begin(), opt.end(), opt.begin(), ::toupper);
+            if (opt == "NX") flags |= ZADD_NX;
+            else if (opt == "XX") flags |= ZADD_XX;
+            else if (opt == "GT") flags |= ZADD_GT;
+            else if (opt == "LT") flags |= ZADD_LT;
+            else if (opt == "CH") ch = true;
+            else if (opt == "INCR") flags |= ZADD_INCR;
+            else break;
+        }
+        std::vector<std::pair<double, std::string>> members;
+        bool valid = tokens.size() >= 4 && i < tokens.size() && (tokens.size() - i) % 2 == 0;
+        for (size_t j = i; valid && j < tokens.size(); j += 2) {
+            double score;
+            if (!RedisSortedSet::parseScore(tokens[j], score)) valid = false;
+            else members.emplace_back(score, tokens[j+1]);
+        }
+        if (tokens.size() < 4 || (tokens.size() - i) % 2 != 0) {
+            response << "-ERR wrong number of arguments for 'zadd' command\r\n";
+        } else if (!valid) {
+            response << "-ERR value is not a valid float\r\n";
+        } else if ((flags & ZADD_NX) && (flags & ZADD_XX)) {
+            response << "-ERR XX and NX options at the same time are not compatible\r\n";
+        } else if (((flags & ZADD_GT) && (flags & ZADD_LT)) || ((flags & ZADD_NX) && (flags & (ZADD_GT | ZADD_LT)))) {
+            response << "-ERR GT, LT, and/or NX options at the same time are not compatible\r\n";
+        } else if ((flags & ZADD_INCR) && members.size() != 1) {
+            response << "-ERR INCR option supports a single increment-element pair\r\n";
+        } else if (flags & ZADD_INCR) {
+            ZAddResult result;
+            double newScore;
+            if (!db.zincrby(tokens[1], members[0].second, members[0].first, flags, result, newScore)) {
+                response << "-ERR resulting score is not a number (NaN)\r\n";
+            } else if (result == ZADD_NOP) {
+                response << "$-1\r\n";
+            } else {
+                std::string score = RedisSortedSet::formatScore(newScore);
+                response << "$" << score.size() << "\r\n" << score << "\r\n";
+            }
+        } else {
+            response << ":" << db.zadd(tokens[1], members, flags, ch) << "\r\n";
+        }
+    } else if (cmd == "ZINCRBY") {
+        double increment;
+        if (tokens.size() < 4) {
+            response << "-ERR wrong number of arguments for 'zincrby' command\r\n";
+        } else if (!RedisSortedSet::parseScore(tokens[2], increment)) {
+            response << "-ERR value is not a valid float\r\n";
+        } else {
+            ZAddResult result;
+            double newScore;
+            if (!db.zincrby(tokens[1], tokens[3], increment, 0, result, newScore)) {
+                response << "-ERR resulting score is not a number (NaN)\r\n";
+            } else {
+                std::string score = RedisSortedSet::formatScore(newScore);
+                response << "$" << score.size() << "\r\n" << score << "\r\n";
+            }
+        }
+    } else if (cmd == "ZREM") {
+        if (tokens.size() < 3) {
+            response << "-ERR wrong number of arguments for 'zrem' command\r\n";
+        } else {
+            size_t removed = db.zrem(tokens[1], std::vector<std::string>(tokens.begin() + 2, tokens.end()));
+            response << ":" << removed << "\r\n";
+        }
+    } else if (cmd == "ZSCORE") {
+        if (tokens.size() < 3) {
+            response << "-ERR wrong number of arguments for 'zscore' command\r\n";
+        } else {
+            double score;
+            if (db.zscore(tokens[1], tokens[2], score)) {
+                std::string value = RedisSortedSet::formatScore(score);
+                response << "$" << value.size() << "\r\n" << value << "\r\n";
+            } else {
+                response << "$-1\r\n";  // nothing to get
+            }
+        }
+    } else if (cmd == "ZCARD") {
+        if (tokens.size() < 2) {
+            response << "-ERR wrong number of arguments for 'zcard' command\r\n";
+        } else {
+            response << ":" << db.zcard(tokens[1]) << "\r\n";
+        }
+    } else if (cmd == "ZRANK" || cmd == "ZREVRANK") {
+        if (tokens.size() < 3) {
+            response << "-ERR wrong number of arguments for '" << (cmd == "ZRANK" ? "zrank" : "zrevrank") << "' command\r\n";
+        } else {
+            long rank = db.zrank(tokens[1], tokens[2], cmd == "ZREVRANK");
+            if (rank >= 0) {
+                response << ":" << rank << "\r\n";
+            } else {
+                response << "$-1\r\n";  // nothing to get
+            }
+        }
+    } else if (cmd == "ZCOUNT") {
+        ZScoreRange range;
+        if (tokens.size() < 4) {
+            response << "-ERR wrong number of arguments for 'zcount' command\r\n";
+        } else if (!RedisSortedSet::parseScoreRange(tokens[2], tokens[3], range)) {
+            response << "-ERR min or max is not a float\r\n";
+        } else {
+            response << ":" << db.zcount(tokens[1], range) << "\r\n";
+        }
+    } else if (cmd == "ZRANGE") {
+        // ZRANGE key start stop [BYSCORE|BYLEX] [REV] [LIMIT offset count] [WITHSCORES]
+        bool byScore = false, byLex = false, rev = false, withScores = false, hasLimit = false, syntaxError = false;
+        long offset = 0, limit = -1;
+        for (size_t i = 4; i < tokens.size() && !syntaxError; i++) {
+            std::string opt = tokens[i];
+            std::transform(opt.begin(), opt.end(), opt.begin(), ::toupper);
+            if (opt == "BYSCORE") byScore = true;
+            else if (opt == "BYLEX") byLex = true;
+            else if (opt == "REV") rev = true;
+            else if (opt == "WITHSCORES") withScores = true;
+            else if (opt == "LIMIT" && i + 2 < tokens.size()) {
+                try {
+                    offset = std::stol(tokens[i+1]);
+                    limit = std::stol(tokens[i+2]);
+                    hasLimit = true;
+                    i += 2;
+                } catch (const std::exception&) {
+                    syntaxError = true;
+                }
+            } else syntaxError = true;
+        }
+        if (tokens.size() < 4) {
+            response << "-ERR wrong number of arguments for 'zrange' command\r\n";
+        } else if (syntaxError || (byScore && byLex)) {
+            response << "-ERR syntax error\r\n";
+        } else if (hasLimit && !byScore && !byLex) {
+            response << "-ERR syntax error, LIMIT is only supported in combination with either BYSCORE or BYLEX\r\n";
+        } else if (withScores && byLex) {
+            response << "-ERR syntax error, WITHSCORES not supported in combination with BYLEX\r\n";
+        } else {
+            // with REV the range is given as max min
+            const std::string& min = rev && (byScore || byLex) ? tokens[3] : tokens[2];
+            const std::string& max = rev && (byScore || byLex) ? tokens[2] : tokens[3];
+            std::vector<std::pair<std::string, double>> elements;
+            bool valid = true;
+            if (byScore) {
+                ZScoreRange range;
+                valid = RedisSortedSet::parseScoreRange(min, max, range);
+                if (valid) elements = db.zrangeByScore(tokens[1], range, rev, offset, limit);
+                else response << "-ERR min or max is not a float\r\n";
+            } else if (byLex) {
+                ZLexRange range;
+                valid = RedisSortedSet::parseLexRange(min, max, range);
+                if (valid) elements = db.zrangeByLex(tokens[1], range, rev, offset, limit);
+                else response << "-ERR min or max not valid string range item\r\n";
+            } else {
+                try {
+                    elements = db.zrange(tokens[1], std::stol(tokens[2]), std::stol(tokens[3]), rev);
+                } catch (const std::exception&) {
+                    valid = false;
+                    response << "-ERR value is not an integer or out of range\r\n";
+                }
+            }
+            if (valid) {
+                response << "*" << (withScores ? elements.size() * 2 : elements.size()) << "\r\n";
+                for (const auto& element : elements) {
+                    response << "$" << element.first.size() << "\r\n" << element.first << "\r\n";
+                    if (withScores) {
+                        std::string score = RedisSortedSet::formatScore(element.second);
+                        response << "$" << score.size() << "\r\n" << score << "\r\n";
+                    }
+                }
+            }
+        }
+    }
+    // HyperLogLog operations
+    else if (cmd == "PFADD") {
+        if (tokens.size() < 2) {
+            response << "-ERR wrong number of arguments for 'pfadd' command\r\n";
+        } else {
+            int updated = db.pfadd(tokens[1], std::vector<std::string>(tokens.begin() + 2, tokens.end()));
+            if (updated < 0) response << "-WRONGTYPE Key is not a valid HyperLogLog string value.\r\n";
+            else response << ":" << updated << "\r\n";
+        }
+    } else if (cmd == "PFCOUNT") {
+        if (tokens.size() < 2) {
+            response << "-ERR wrong number of arguments for 'pfcount' command\r\n";
+        } else {
+            long long count = db.pfcount(std::vector<std::string>(tokens.begin() + 1, tokens.end()));
+            if (count < 0) response << "-WRONGTYPE Key is not a valid HyperLogLog string value.\r\n";
+            else response << ":" << count << "\r\n";
+        }
+    } else if (cmd == "PFMERGE") {
+        if (tokens.size() < 2) {
+            response << "-ERR wrong number of arguments for 'pfmerge' command\r\n";
+        } else if (!db.pfmerge(tokens[1], std::vector<std::string>(tokens.begin() + 2, tokens.end()))) {
+            response << "-WRONGTYPE Key is not a valid HyperLogLog string value.\r\n";
+        } else {
+            response << "+OK\r\n";
+        }
+    }
+    // bitmap operations
+    else if (cmd == "SETBIT") {
+        uint64_t offset;
+        if (tokens.size() < 4) {
+            response << "-ERR wrong number of arguments for 'setbit' command\r\n";
+        } else if (!parseBitOffset(tokens[2], offset)) {
+            response << "-ERR bit offset is not an integer or out of range\r\n";
+        } else if (tokens[3] != "0" && tokens[3] != "1") {
+            response << "-ERR bit is not an integer or out of range\r\n";
+        } else {
+            response << ":" << db.setbit(tokens[1], offset, tokens[3] == "1") << "\r\n";
+        }
+    } else if (cmd == "GETBIT") {
+        uint64_t offset;
+        if (tokens.size() < 3) {
+            response << "-ERR wrong number of arguments for 'getbit' command\r\n";
+        } else if (!parseBitOffset(tokens[2], offset)) {
+            response << "-ERR bit offset is not an integer or out of range\r\n";
+        } else {
+            response << ":" << db.getbit(tokens[1], offset) << "\r\n";
+        }
+    } else if (cmd == "BITCOUNT") {
+        response << bitcountCommand(tokens);
+    } else if (cmd == "BITPOS") {
+        response << bitposCommand(tokens);
+    } else if (cmd == "BITOP") {
+        response << bitopCommand(tokens);
+    } else if (cmd == "BITFIELD" || cmd == "BITFIELD_RO") {
+        response << bitfieldCommand(tokens, cmd == "BITFIELD_RO");
+    }
+    // key statistics
+    else if (cmd == "INFO") {
+        response << infoCommand(tokens);
+    } else if (cmd == "MEMORY") {
+        response << memoryCommand(tokens);
+    } else if (cmd == "HOTKEYS") {
+        response << hotkeysCommand(tokens);
+    } else if (cmd == "BIGKEYS") {
+        response << bigkeysCommand(tokens);
+    }
+    //pub/sub operations
+    else if (cmd == "SUBSCRIBE") {
+        if (tokens.size() < 2) {
+            response << "-ERR wrong number of arguments for 'subscribe' command\r\n";
+        } else {
+            response << pubsub.subscribe(client, std::vector<std::string>(tokens.begin() + 1, tokens.end()));
+        }
+    } else if (cmd == "UNSUBSCRIBE") {
+        response << pubsub.unsubscribe(client, std::vector<std::string>(tokens.begin() + 1, tokens.end()));
+    } else if (cmd == "PSUBSCRIBE") {
+        if (tokens.size() < 2) {
+            response << "-ERR wrong number of arguments for 'psubscribe' command\r\n";
+        } else {
+            response << pubsub.psubscribe(client, std::vector<std::string>(tokens.begin() + 1, tokens.end()));
+        }
+    } else if (cmd == "PUNSUBSCRIBE") {
+        response << pubsub.punsubscribe(client, std::vector<std::string>(tokens.begin() + 1, tokens.end()));
+    } else if (cmd == "PUBLISH") {
+        if (tokens.size() < 3) {
+            response << "-ERR wrong number of arguments for 'publish' command\r\n";
+        } else {
+            size_t receivers = pubsub.publish(tokens[1], tokens[2]);
+            response << ":" << receivers << "\r\n";
+        }
+    }
+    //cluster operations
+    else if (cmd == "CLUSTER") {
+        if (!cluster.isEnabled()) {
+            response << "-ERR This instance has cluster support disabled\r\n";
+        } else {
+            response << cluster.command(tokens);
+        }
+    } else if (cmd == "ASKING") {
+        if (!cluster.isEnabled()) {
+            response << "-ERR This instance has cluster support disabled\r\n";
+        } else {
+            client.asking = true;
+            response << "+OK\r\n";
+        }
+    } else if (cmd == "DUMP") {
+        if (tokens.size() < 2) {
+            response << "-ERR wrong number of arguments for 'dump' command\r\n";
+        } else {
+            std::string payload;
+            if (db.dumpKey(tokens[1], payload)) {
+                response << "$" << payload.size() << "\r\n" << payload << "\r\n";
+            } else {
+                response << "$-1\r\n";
+            }
+        }
+    } else if (cmd == "RESTORE" || cmd == "RESTORE-ASKING") {
+        response << restoreCommand(tokens);
+    } else if (cmd == "MIGRATE") {
+        response << migrateCommand(tokens);
+    } else if (cmd == "CLIENT") {
+        response << clientCommand(tokens, client);
+    } else if (cmd == "HELLO") {
+        response << helloCommand(tokens, client);
+    } else if (cmd == "QUIT") {
+        client.close_after_reply = true;
+        response << "+OK\r\n";
+    }
     else {
         response << "-ERR unknown command\r\n";
     }
@@ -0,0 +1,128 @@
+#include "../include/RedisCompression.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+RedisCompression& RedisCompression::getInstance() {
+    static RedisCompression instance;
+    return instance;
+}
+
+void RedisCompression::account(long long values, long long compressedBytes, long long rawBytes) {
+    compressed_values += values;
+    compressed_bytes += compressedBytes;
+    raw_bytes += rawBytes;
+}
+
+/*
+ * LZF format, one control byte per item:
+ * 000lllll                      : literal run of lllll + 1 bytes follows
+ * LLLooooo [llllllll] oooooooo  : copy LLL + 2 bytes from offset o + 1 back;
+ *                                 LLL = 7 adds the optional byte to the length
+*/
+static const unsigned LZF_HASH_LOG = 14;
+static const size_t LZF_MAX_LITERAL = 1 << 5;
+static const size_t LZF_MAX_OFFSET = 1 << 13;
+static const size_t LZF_MAX_MATCH = (1 << 8) + (1 << 3);
+
+static inline uint32_t lzfHash(const uint8_t* p) {
+    uint32_t v = (p[0] << 16) | (p[1] << 8) | p[2];
+    return (v * 2654435761u) >> (32 - LZF_HASH_LOG);
+}
+
+bool RedisCompression::compress(const char* input, size_t size, std::string& output, size_t maxSize) {
+    // position + 1 of the last occurrence of each hash. Not cleared between
+    // calls: a stale entry below ip points inside this input and every
+    // candidate is checked byte by byte, so it only costs a missed match
+    thread_local uint32_t table[1 << LZF_HASH_LOG];
+
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(input);
+    output.resize(maxSize);
+    uint8_t* out = reinterpret_cast<uint8_t*>(&output[0]);
+    size_t o = 0;
+
+    auto literals = [&](size_t from, size_t to) {
+        while (from < to) {
+            size_t run = std::min(LZF_MAX_LITERAL, to - from);
+            if (o + 1 + run > maxSize) return false;
+            out[o++] = static_cast<uint8_t>(run - 1);
+            memcpy(out + o, in + from, run);
+            o += run;
+            from += run;
+        }
+        return true;
+    };
+
+    size_t ip = 0, literalStart = 0;
+    while (ip + 2 < size) {
+        uint32_t hash = lzfHash(in + ip);
+        size_t candidate = table[hash];
+        table[hash] = static_cast<uint32_t>(ip + 1);
+        if (candidate != 0 && candidate - 1 < ip) {
+            size_t ref = candidate - 1;
+            size_t offset = ip - ref - 1;
+            if (offset < LZF_MAX_OFFSET && memcmp(in + ref, in + ip, 3) == 0) {
+                size_t limit = std::min(LZF_MAX_MATCH, size - ip);
+                size_t len = 3;
+                while (len < limit && in[ref + len] == in[ip + len]) len++;
+                if (!literals(literalStart, ip) || o + 3 > maxSize) return false;
+                size_t code = len - 2;
+                if (code < 7) {
+                    out[o++] = static_cast<uint8_t>((code << 5) | (offset >> 8));
+                } else {
+                    out[o++] = static_cast<uint8_t>((7 << 5) | (offset >> 8));
+                    out[o++] = static_cast<uint8_t>(code - 7);
+                }
+                out[o++] = static_cast<uint8_t>(offset & 0xff);
+                // index the positions inside the match as well
+                for (size_t k = ip + 1; k < ip + len && k + 2 < size; k++) {
+                    table[lzfHash(in + k)] = static_cast<uint32_t>(k + 1);
+                }
+                ip += len;
+                literalStart = ip;
+                continue;
+            }
+        }
+        ip++;
+    }
+    if (!literals(literalStart, size)) return false;
+    output.resize(o);
+    return true;
+}
+
+bool RedisCompression::decompress(const char* input, size_t size, std::string& output, size_t rawSize) {
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(input);
+    output.resize(rawSize);
+    uint8_t* out = reinterpret_cast<uint8_t*>(&output[0]);
+    size_t i = 0, o = 0;
+    while (i < size) {
+        size_t control = in[i++];
+        if (control < LZF_MAX_LITERAL) {
+            size_t run = control + 1;
+            if (i + run > size || o + run > rawSize) return false;
+            memcpy(out + o, in + i, run);
+            i += run;
+            o += run;
+            continue;
+        }
+        size_t len = control >> 5;
+        if (len == 7) {
+            if (i >= size) return false;
+            len += in[i++];
+        }
+        if (i >= size) return false;
+        size_t offset = ((control & 0x1f) << 8) | in[i++];
+        len += 2;
+        if (offset + 1 > o || o + len > rawSize) return false;
+        size_t ref = o - offset - 1;
+        if (offset + 1 >= len) {
+            memcpy(out + o, out + ref, len);
+        } else {
+            // overlapping copy repeats the last offset + 1 bytes
+            for (size_t k = 0; k < len; k++) out[o + k] = out[ref + k];
+        }
+        o += len;
+    }
+    return o == rawSize;
+}
@@ -0,0 +1,158 @@
+#include "../include/RedisConnection.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+RedisConnection::RedisConnection() : fd(-1), in_pos(0) {}
+
+RedisConnection::~RedisConnection() {
+    close();
+}
+
+bool RedisConnection::connect(const std::string& host, int port, int timeoutMs) {
+    close();
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res) != 0 || !res) return false;
+
+    fd = socket(res->ai_family, res->ai_socktype, 0);
+    if (fd < 0) {
+        freeaddrinfo(res);
+        fd = -1;
+        return false;
+    }
+    timeval tv{};
+    tv.tv_sec = timeoutMs / 1000;
+    tv.tv_usec = (timeoutMs % 1000) * 1000;
+    // SO_SNDTIMEO also bounds connect()
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    bool ok = ::connect(fd, res->ai_addr, res->ai_addrlen) == 0;
+    freeaddrinfo(res);
+    if (!ok) close();
+    return ok;
+}
+
+void RedisConnection::close() {
+    if (fd != -1) ::close(fd);
+    fd = -1;
+    out.clear();
+    in.clear();
+    in_pos = 0;
+}
+
+void RedisConnection::append(const std::vector<std::string>& args) {
+    out += "*" + std::to_string(args.size()) + "\r\n";
+    for (const auto& arg : args) {
+        out += "$" + std::to_string(arg.size()) + "\r\n";
+        out += arg;
+        out += "\r\n";
+    }
+}
+
+bool RedisConnection::flush() {
+    size_t sent = 0;
+    while (sent < out.size()) {
+        ssize_t n = send(fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            close();
+            return false;
+        }
+        sent += n;
+    }
+    out.clear();
+    return true;
+}
+
+bool RedisConnection::fill() {
+    if (in_pos > 0 && in_pos == in.size()) {
+        in.clear();
+        in_pos = 0;
+    }
+    char buffer[16 * 1024];
+    ssize_t n;
+    do {
+        n = recv(fd, buffer, sizeof(buffer), 0);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        close();
+        return false;
+    }
+    in.append(buffer, n);
+    return true;
+}
+
+bool RedisConnection::readLine(std::string& line) {
+    while (true) {
+        size_t crlf = in.find("\r\n", in_pos);
+        if (crlf != std::string::npos) {
+            line = in.substr(in_pos, crlf - in_pos);
+            in_pos = crlf + 2;
+            return true;
+        }
+        if (!fill()) return false;
+    }
+}
+
+bool RedisConnection::readBytes(size_t count, std::string& data) {
+    while (in.size() - in_pos < count + 2) {
+        if (!fill()) return false;
+    }
+    data = in.substr(in_pos, count);
+    in_pos += count + 2;
+    return true;
+}
+
+bool RedisConnection::readReply(RedisConnectionReply& reply) {
+    if (fd == -1) return false;
+    if (!out.empty() && !flush()) return false;
+    std::string line;
+    if (!readLine(line) || line.empty()) return false;
+    reply = RedisConnectionReply();
+    reply.type = line[0];
+    switch (reply.type) {
+        case '+':
+        case '-':
+            reply.str = line.substr(1);
+            return true;
+        case ':':
+            reply.integer = strtoll(line.c_str() + 1, nullptr, 10);
+            return true;
+        case '$': {
+            long len = strtol(line.c_str() + 1, nullptr, 10);
+            if (len < 0) {
+                reply.nil = true;
+                return true;
+            }
+            return readBytes(len, reply.str);
+        }
+        case '*': {
+            long count = strtol(line.c_str() + 1, nullptr, 10);
+            if (count < 0) {
+                reply.nil = true;
+                return true;
+            }
+            reply.elements.resize(count);
+            for (long i = 0; i < count; i++) {
+                if (!readReply(reply.elements[i])) return false;
+            }
+            return true;
+        }
+        default:
+            close();
+            return false;
+    }
+}
+
+bool RedisConnection::command(const std::vector<std::string>& args, RedisConnectionReply& reply) {
+    append(args);
+    return readReply(reply);
+}
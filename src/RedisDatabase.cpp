@@ -1,37 +1,155 @@
 
 #include "../include/RedisDatabase.h"
+#include "../include/RedisCluster.h"
+#include "../include/RedisCompression.h"
+#include "../include/RedisHyperLogLog.h"
+#include "../include/RedisLazyFree.h"
+#include "../include/RedisReadCache.h"
+#include "../include/RedisTracking.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <ios>
 #include <sstream>
+#include <thread>
+#include <tuple>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+// Free effort of a value (~ number of allocations its destructor releases),
+// used to decide if it is worth freeing it in the background
+static size_t freeEffort(const RedisString&) { return 1; }
+static size_t freeEffort(const std::vector<RedisString>& list) { return list.size(); }
+static size_t freeEffort(const std::unordered_map<std::string, std::string>& hash) { return hash.size(); }
+static size_t freeEffort(const RedisSortedSet& zset) { return zset.isPacked() ? 1 : zset.size(); }
+
+// Estimated bytes of a value (MEMORY USAGE, BIGKEYS); containers measure
+// samples elements and extrapolate, 0 measures all of them
+static size_t stringHeap(const std::string& s) { return s.capacity() > 15 ? s.capacity() + 1 : 0; }
+static size_t valueBytes(const RedisString& value, size_t) { return sizeof(RedisString) + value.allocated(); }
+static size_t valueBytes(const std::vector<RedisString>& list, size_t samples) {
+    size_t measured = 0, heap = 0;
+    for (; measured < list.size() && (samples == 0 || measured < samples); measured++) {
+        heap += list[measured].allocated();
+    }
+    size_t bytes = sizeof(list) + list.capacity() * sizeof(RedisString);
+    return measured ? bytes + heap * list.size() / measured : bytes;
+}
+static size_t valueBytes(const std::unordered_map<std::string, std::string>& hash, size_t samples) {
+    size_t measured = 0, heap = 0;
+    for (auto it = hash.begin(); it != hash.end() && (samples == 0 || measured < samples); ++it, measured++) {
+        heap += stringHeap(it->first) + stringHeap(it->second);
+    }
+    // buckets, then per node: next pointer, cached hash, field and value
+    size_t bytes = sizeof(hash) + hash.bucket_count() * sizeof(void*) +
+        hash.size() * (2 * sizeof(void*) + 2 * sizeof(std::string));
+    return measured ? bytes + heap * hash.size() / measured : bytes;
+}
+static size_t valueBytes(const RedisSortedSet& zset, size_t samples) { return zset.memoryUsage(samples); }
+// keyspace node: next pointer, cached hash and the key
+static size_t entryBytes(const std::string& key) { return 2 * sizeof(void*) + sizeof(std::string) + stringHeap(key); }
+
+template <typename Store>
+static bool measureKey(const Store& store, const std::string& key, size_t samples, long long& bytes) {
+    auto it = store.find(key);
+    if (it == store.end()) return false;
+    bytes = entryBytes(key) + valueBytes(it->second, samples);
+    return true;
+}
+
+// visits the next buckets of store, true when it reached the last one
+template <typename Store>
+static bool scanStore(const Store& store, const char* type, RedisDatabase::KeyScanCursor& cursor, size_t buckets,
+                      size_t samples, const RedisDatabase::KeySizeVisitor& visit) {
+    // a rehash since the last step moved keys to other buckets: walk it again
+    if (cursor.bucket != 0 && store.bucket_count() != cursor.bucket_count) {
+        cursor.bucket = 0;
+        cursor.restarts++;
+    }
+    cursor.bucket_count = store.bucket_count();
+    size_t& bucket = cursor.bucket;
+    size_t end = std::min(store.bucket_count(), bucket + buckets);
+    for (; bucket < end; bucket++) {
+        for (auto it = store.begin(bucket); it != store.end(bucket); ++it) {
+            visit(it->first, type, it->second.size(), entryBytes(it->first) + valueBytes(it->second, samples));
+        }
+    }
+    return bucket >= store.bucket_count();
+}
+
+// buckets of expire_store visited by one activeExpireCycle() call
+static const size_t ACTIVE_EXPIRE_BUCKETS = 1024;
 
 RedisDatabase& RedisDatabase::getInstance() {
     static RedisDatabase instance;
     return instance;
 }
 
-bool RedisDatabase::flushAll() {
+bool RedisDatabase::flushAll(bool async) {
     std::lock_guard<std::mutex> lock(db_mutex);
+    if (async) {
+        // moving the maps out is O(1); the old keyspace is destroyed off the serving path
+        RedisLazyFree::getInstance().freeAsync(std::make_tuple(std::move(kv_store), std::move(list_store),
+                                                               std::move(hash_store), std::move(zset_store),
+                                                               std::move(expire_store), std::move(slot_keys)));
+    }
     kv_store.clear();
     list_store.clear();
     hash_store.clear();
+    zset_store.clear();
+    expire_store.clear();
+    size_t slots = slot_keys.size();
+    slot_keys.clear();
+    slot_keys.resize(slots);
+    RedisReadCache::getInstance().clear();
+    RedisTracking::getInstance().invalidateAll();
     return true;
 }
 
+// head and tail stay raw, they are where pushes and pops happen
+static void compressListInterior(std::vector<RedisString>& list) {
+    for (size_t i = 1; i + 1 < list.size(); i++) list[i].compress();
+}
+
 void RedisDatabase::set(const std::string& key, const std::string& value) {
+    RedisString stored(value);
+    stored.compress(); // before taking db_mutex
     std::lock_guard<std::mutex> lock(db_mutex);
-    kv_store[key] = value;
+    kv_store[key] = std::move(stored);
+    slotAdd(key);
+    signalModifiedKey(key);
 };
 bool RedisDatabase::get(const std::string& key, std::string& value) {
-    std::lock_guard<std::mutex> lock(db_mutex);
-    auto it = kv_store.find(key);
-    if (it != kv_store.end()) {
-        value = it->second;
-        return true;
+    RedisReadCache& cache = RedisReadCache::getInstance();
+    size_t keyHash = RedisReadCache::hashKey(key);
+    bool admit;
+    if (cache.get(key, keyHash, value, admit)) return true;
+    RedisString compressed;
+    uint64_t version = 0;
+    {
+        std::lock_guard<std::mutex> lock(db_mutex);
+        auto it = kv_store.find(key);
+        if (it == kv_store.end()) return false;
+        if (it->second.isCompressed()) {
+            compressed = it->second;
+        } else {
+            value = it->second.value();
+            if (admit) version = cache.version(keyHash);
+        }
     }
-    return false;
+    // decompress or fill the cache once db_mutex is released
+    if (compressed.isCompressed()) {
+        value = compressed.value();
+    } else if (admit) {
+        cache.publish(key, keyHash, value, version);
+    }
+    return true;
 };
 std::vector<std::string>RedisDatabase:: keys() {
     std::lock_guard<std::mutex> lock(db_mutex);
@@ -45,6 +163,10 @@ std::vector<std::string>RedisDatabase:: keys() {
     for (const auto& kv : hash_store) {
         result.push_back(kv.first);
     }
+    for (const auto& kv : zset_store) {
+        result.push_back(kv.first);
+    }
+    return result;
 };
 std::string RedisDatabase::type(const std::string& key) {
     std::lock_guard<std::mutex> lock(db_mutex);
@@ -55,7 +177,10 @@ std::string RedisDatabase::type(const std::string& key) {
         return "list";
     }
     if (hash_store.find(key) != hash_store.end()) {
-        return "list";
+        return "hash";
+    }
+    if (zset_store.find(key) != zset_store.end()) {
+        return "zset";
     }
     return "none";
 };
@@ -65,46 +190,141 @@ bool RedisDatabase::del(const std::string& key) {
     erased |= kv_store.erase(key) > 0;
     erased |= list_store.erase(key) > 0;
     erased |= hash_store.erase(key) > 0;
+    erased |= zset_store.erase(key) > 0;
+    expire_store.erase(key);
+    if (erased) {
+        slotRemove(key);
+        signalModifiedKey(key);
+    }
     return erased;
 };
+bool RedisDatabase::unlink(const std::string& key) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    if (!detachKey(key)) return false;
+    signalModifiedKey(key);
+    return true;
+};
+bool RedisDatabase::detachKey(const std::string& key) {
+    RedisLazyFree& lazyfree = RedisLazyFree::getInstance();
+    bool found = false;
+    // extract() unlinks the node in O(1); the node handle owns key and value
+    auto itKv = kv_store.find(key);
+    if (itKv != kv_store.end()) {
+        size_t effort = freeEffort(itKv->second);
+        lazyfree.free(kv_store.extract(itKv), effort);
+        found = true;
+    }
+    auto itList = list_store.find(key);
+    if (itList != list_store.end()) {
+        size_t effort = freeEffort(itList->second);
+        lazyfree.free(list_store.extract(itList), effort);
+        found = true;
+    }
+    auto itHash = hash_store.find(key);
+    if (itHash != hash_store.end()) {
+        size_t effort = freeEffort(itHash->second);
+        lazyfree.free(hash_store.extract(itHash), effort);
+        found = true;
+    }
+    auto itZset = zset_store.find(key);
+    if (itZset != zset_store.end()) {
+        size_t effort = freeEffort(itZset->second);
+        lazyfree.free(zset_store.extract(itZset), effort);
+        found = true;
+    }
+    expire_store.erase(key);
+    if (found) slotRemove(key);
+    return found;
+}
 // expire
 bool RedisDatabase::expire(const std::string& key, std::string& seconds) {
     std::lock_guard<std::mutex> lock(db_mutex);
-    bool exists = (kv_store.find(key) != kv_store.end()) ||
-        (list_store.find(key) != list_store.end()) ||
-            (hash_store.find(key) != hash_store.end());
-    if (!exists) return false;
+    if (!keyExists(key)) return false;
     expire_store[key] = std::chrono::steady_clock::now() + std::chrono::seconds(std::stoi(seconds));
+    signalModifiedKey(key);
     return true;
 };
+// delete the expired keys found in the next ACTIVE_EXPIRE_BUCKETS buckets of expire_store
+size_t RedisDatabase::activeExpireCycle() {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    if (expire_store.empty()) return 0;
+    auto now = std::chrono::steady_clock::now();
+    std::vector<std::string> expired;
+    size_t buckets = expire_store.bucket_count();
+    for (size_t i = 0; i < ACTIVE_EXPIRE_BUCKETS && i < buckets; i++) {
+        size_t bucket = expire_cursor++ % buckets;
+        for (auto it = expire_store.begin(bucket); it != expire_store.end(bucket); ++it) {
+            if (it->second <= now) expired.push_back(it->first);
+        }
+    }
+    expire_cursor %= buckets;
+    for (const auto& key : expired) {
+        if (detachKey(key)) signalModifiedKey(key);
+        else expire_store.erase(key);
+    }
+    return expired.size();
+}
+long long RedisDatabase::pttl(const std::string& key) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    if (!keyExists(key)) return -2;
+    auto it = expire_store.find(key);
+    if (it == expire_store.end()) return -1;
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(it->second - std::chrono::steady_clock::now());
+    return left.count() > 0 ? left.count() : 0;
+};
+bool RedisDatabase::exists(const std::string& key) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    return keyExists(key);
+};
+bool RedisDatabase::keyExists(const std::string& key) {
+    return (kv_store.find(key) != kv_store.end()) ||
+        (list_store.find(key) != list_store.end()) ||
+            (hash_store.find(key) != hash_store.end()) ||
+                (zset_store.find(key) != zset_store.end());
+}
 // rename
 bool RedisDatabase::rename(const std::string& oldkey, const std::string& newkey) {
     std::lock_guard<std::mutex> lock(db_mutex);
+    if (!keyExists(oldkey)) return false;
+    if (oldkey == newkey) return true;
+    // whatever newkey held is overwritten, free it without blocking
+    detachKey(newkey);
+
     bool found = false;
     auto itKv = kv_store.find(oldkey);
     if (itKv != kv_store.end()) {
-        kv_store[newkey] = itKv->second;
+        kv_store[newkey] = std::move(itKv->second);
         found = true;
         kv_store.erase(itKv);
     }
     auto itList = list_store.find(oldkey);
     if (itList != list_store.end()) {
-        list_store[newkey] = itList->second;
+        list_store[newkey] = std::move(itList->second);
         found = true;
         list_store.erase(itList);
     }
     auto itHash = hash_store.find(oldkey);
     if (itHash != hash_store.end()) {
-        hash_store[newkey] = itHash->second;
+        hash_store[newkey] = std::move(itHash->second);
         found = true;
         hash_store.erase(itHash);
     }
+    auto itZset = zset_store.find(oldkey);
+    if (itZset != zset_store.end()) {
+        zset_store[newkey] = std::move(itZset->second);
+        found = true;
+        zset_store.erase(itZset);
+    }
     auto itExpire = expire_store.find(oldkey);
     if (itExpire != expire_store.end()) {
         expire_store[newkey] = itExpire->second;
         found = true;
         expire_store.erase(itExpire);
     }
+    slotRemove(oldkey);
+    slotAdd(newkey);
+    signalModifiedKey(oldkey);
+    signalModifiedKey(newkey);
     return found;
 };
 
@@ -118,22 +338,61 @@ ssize_t RedisDatabase::llen(const std::string& key) {
     return 0;
 };
 
-void RedisDatabase::lpush(const std::string& key, const std::string& value) {
+// copy of an element that became interior, when it is worth compressing
+static void copyForCompression(RedisString& element, std::string& interior) {
+    size_t threshold = RedisCompression::getInstance().threshold();
+    if (threshold == 0 || element.isCompressed() || element.size() < threshold) return;
+    interior = element.raw();
+}
+
+void RedisDatabase::compressPushed(const std::string& key, const std::string& interior, bool head) {
+    if (interior.empty()) return;
+    RedisString packed(interior);
+    packed.compress();
+    if (!packed.isCompressed()) return;
     std::lock_guard<std::mutex> lock(db_mutex);
-    list_store[key].insert(list_store[key].begin(), value);
+    auto it = list_store.find(key);
+    if (it == list_store.end() || it->second.size() <= 2) return;
+    // a push or pop in between moved it: it stays raw, which only costs memory
+    RedisString& element = head ? it->second[1] : it->second[it->second.size() - 2];
+    if (!element.isCompressed() && element.raw() == interior) element = std::move(packed);
+}
+
+void RedisDatabase::lpush(const std::string& key, const std::string& value) {
+    std::string interior;
+    {
+        std::lock_guard<std::mutex> lock(db_mutex);
+        auto& list = list_store[key];
+        list.insert(list.begin(), value);
+        // the old head is now an interior element
+        if (list.size() > 2) copyForCompression(list[1], interior);
+        slotAdd(key);
+        signalModifiedKey(key);
+    }
+    compressPushed(key, interior, true);
 };
 
 void RedisDatabase::rpush(const std::string& key, const std::string& value) {
-    std::lock_guard<std::mutex> lock(db_mutex);
-    list_store[key].push_back(value);
+    std::string interior;
+    {
+        std::lock_guard<std::mutex> lock(db_mutex);
+        auto& list = list_store[key];
+        list.push_back(value);
+        if (list.size() > 2) copyForCompression(list[list.size() - 2], interior);
+        slotAdd(key);
+        signalModifiedKey(key);
+    }
+    compressPushed(key, interior, false);
 };
 
 bool RedisDatabase::lpop(const std::string& key, std::string& value) {
     std::lock_guard<std::mutex> lock(db_mutex);
     auto it = list_store.find(key);
     if (it != list_store.end() && !it->second.empty()) {
-        value = it->second.front();
+        value = it->second.front().value();
         it->second.erase(it->second.begin());
+        if (!it->second.empty()) it->second.front().raw();
+        signalModifiedKey(key);
         return true;
     }
     return false;
@@ -142,8 +401,10 @@ bool RedisDatabase::rpop(const std::string& key, std::string& value) {
     std::lock_guard<std::mutex> lock(db_mutex);
     auto it = list_store.find(key);
     if (it != list_store.end() && !it->second.empty()) {
-        value = it->second.front();
+        value = it->second.back().value();
         it->second.pop_back();
+        if (!it->second.empty()) it->second.back().raw();
+        signalModifiedKey(key);
         return true;
     }
     return false;
@@ -179,12 +440,20 @@ int RedisDatabase::lrem(const std::string& key, int count, std::string& value) {
                 --fwdIterator;
                 fwdIterator = list.erase(fwdIterator);
                 ++removed;
-                riter = std::reverse_iterator<std::vector<std::string>::iterator>(fwdIterator);
+                riter = std::reverse_iterator<std::vector<RedisString>::iterator>(fwdIterator);
             } else {
                 ++riter;
             }
         }
     }
+    if (removed > 0) {
+        if (!list.empty()) {
+            list.front().raw();
+            list.back().raw();
+        }
+        signalModifiedKey(key);
+    }
+    return removed;
 }
 
 bool RedisDatabase::lindex(const std::string& key, int index, std::string& value) {
@@ -200,7 +469,7 @@ bool RedisDatabase::lindex(const std::string& key, int index, std::string& value
     if (index < 0 || static_cast<ssize_t>(index) >= list.size()) {
         return false;
     }
-    value = list[index];
+    value = list[index].value();
     return true;
 }
 
@@ -223,25 +492,34 @@ bool RedisDatabase::lset(const std::string& key, int index, std::string& value)
 bool RedisDatabase::hset(const std::string& key, const std::string& field, const std::string& value) {
     std::lock_guard<std::mutex> lock(db_mutex);
     hash_store[key][field] = value;
+    slotAdd(key);
+    signalModifiedKey(key);
     return true;
 };
 bool RedisDatabase::hget(const std::string& key, const std::string& field, std::string& value){
-    std::lock_guard<std::mutex> lock(db_mutex);
-    auto it = hash_store.find(key);
-    if (it != hash_store.end()) {
+    RedisReadCache& cache = RedisReadCache::getInstance();
+    size_t keyHash = RedisReadCache::hashKey(key);
+    bool admit;
+    if (cache.hget(key, keyHash, field, value, admit)) return true;
+    uint64_t version = 0;
+    {
+        std::lock_guard<std::mutex> lock(db_mutex);
+        auto it = hash_store.find(key);
+        if (it == hash_store.end()) return false;
         auto f = it->second.find(field);
-        if (f != it->second.end()) {
-            value = f->second;
-            return true;
-        }
+        if (f == it->second.end()) return false;
+        value = f->second;
+        if (admit) version = cache.version(keyHash);
     }
-    return false;
+    if (admit) cache.publish(key, keyHash, field, value, version);
+    return true;
 };
 bool RedisDatabase::hdel(const std::string& key, const std::string& field){
     std::lock_guard<std::mutex> lock(db_mutex);
     auto it = hash_store.find(key);
-    if (it != hash_store.end()) {
-        return it->second.erase(field) > 0;
+    if (it != hash_store.end() && it->second.erase(field) > 0) {
+        signalModifiedKey(key);
+        return true;
     }
     return false;
 };
@@ -295,52 +573,801 @@ bool RedisDatabase::hmset(const std::string& key, const std::vector<std::pair<st
     for (const auto& pair : values) {
         hash_store[key][pair.first] = pair.second;
     }
+    slotAdd(key);
+    signalModifiedKey(key);
+    return true;
+};
+
+// sorted set
+size_t RedisDatabase::zadd(const std::string& key, const std::vector<std::pair<double, std::string>>& members,
+                           int flags, bool ch) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    auto& zset = zset_store[key];
+    size_t added = 0, updated = 0;
+    for (const auto& pair : members) {
+        ZAddResult result;
+        double newScore;
+        zset.add(pair.second, pair.first, flags, result, newScore);
+        if (result == ZADD_ADDED) added++;
+        if (result == ZADD_UPDATED) updated++;
+    }
+    // XX on a missing key must not leave an empty sorted set behind
+    if (zset.size() == 0) {
+        zset_store.erase(key);
+        slotRemove(key);
+    } else {
+        slotAdd(key);
+    }
+    if (added + updated > 0) signalModifiedKey(key);
+    return ch ? added + updated : added;
+}
+
+bool RedisDatabase::zincrby(const std::string& key, const std::string& member, double increment, int flags,
+                            ZAddResult& result, double& newScore) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    auto& zset = zset_store[key];
+    bool ok = zset.add(member, increment, flags | ZADD_INCR, result, newScore);
+    if (zset.size() == 0) {
+        zset_store.erase(key);
+        slotRemove(key);
+    } else {
+        slotAdd(key);
+    }
+    if (result == ZADD_ADDED || result == ZADD_UPDATED) signalModifiedKey(key);
+    return ok;
+}
+
+size_t RedisDatabase::zrem(const std::string& key, const std::vector<std::string>& members) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    auto it = zset_store.find(key);
+    if (it == zset_store.end()) return 0;
+    size_t removed = 0;
+    for (const auto& member : members) {
+        if (it->second.remove(member)) removed++;
+    }
+    if (it->second.size() == 0) {
+        zset_store.erase(it);
+        slotRemove(key);
+    }
+    if (removed > 0) signalModifiedKey(key);
+    return removed;
+}
+
+bool RedisDatabase::zscore(const std::string& key, const std::string& member, double& score) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    auto it = zset_store.find(key);
+    if (it == zset_store.end()) return false;
+    return it->second.score(member, score);
+}
+
+ssize_t RedisDatabase::zcard(const std::string& key) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    auto it = zset_store.find(key);
+    if (it != zset_store.end()) {
+        return it->second.size();
+    }
+    return 0;
+}
+
+long RedisDatabase::zrank(const std::string& key, const std::string& member, bool reverse) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    auto it = zset_store.find(key);
+    if (it == zset_store.end()) return -1;
+    return it->second.rank(member, reverse);
+}
+
+std::vector<std::pair<std::string, double>> RedisDatabase::zrange(const std::string& key, long start, long stop,
+                                                                  bool reverse) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    auto it = zset_store.find(key);
+    if (it == zset_store.end()) return {};
+    long len = it->second.size();
+    // negative indexes count from the end, same as lindex
+    if (start < 0) start = len + start;
+    if (stop < 0) stop = len + stop;
+    if (start < 0) start = 0;
+    if (start > stop || start >= len) return {};
+    return it->second.rangeByRank(start, stop, reverse);
+}
+
+std::vector<std::pair<std::string, double>> RedisDatabase::zrangeByScore(const std::string& key,
+                                                                         const ZScoreRange& range, bool reverse,
+                                                                         long offset, long limit) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    auto it = zset_store.find(key);
+    if (it == zset_store.end()) return {};
+    return it->second.rangeByScore(range, reverse, offset, limit);
+}
+
+std::vector<std::pair<std::string, double>> RedisDatabase::zrangeByLex(const std::string& key,
+                                                                       const ZLexRange& range, bool reverse,
+                                                                       long offset, long limit) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    auto it = zset_store.find(key);
+    if (it == zset_store.end()) return {};
+    return it->second.rangeByLex(range, reverse, offset, limit);
+}
+
+size_t RedisDatabase::zcount(const std::string& key, const ZScoreRange& range) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    auto it = zset_store.find(key);
+    if (it == zset_store.end()) return 0;
+    return it->second.count(range);
+}
+
+int RedisDatabase::pfadd(const std::string& key, const std::vector<std::string>& elements) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    auto it = kv_store.find(key);
+    bool created = false;
+    if (it == kv_store.end()) {
+        it = kv_store.emplace(key, RedisHyperLogLog::create()).first;
+        slotAdd(key);
+        created = true;
+    } else if (!RedisHyperLogLog::isValid(it->second.raw())) {
+        return -1;
+    }
+    bool updated = RedisHyperLogLog::add(it->second.raw(), elements) || created;
+    if (updated) signalModifiedKey(key);
+    return updated ? 1 : 0;
+}
+
+long long RedisDatabase::pfcount(const std::vector<std::string>& keys) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    if (keys.size() == 1) {
+        // only refreshes the cached cardinality, not a modification,
+        // but GET must not serve the bytes from before the refresh
+        auto it = kv_store.find(keys[0]);
+        if (it == kv_store.end()) return 0;
+        std::string& value = it->second.raw();
+        if (!RedisHyperLogLog::isValid(value)) return -1;
+        RedisReadCache::getInstance().invalidate(keys[0]);
+        return RedisHyperLogLog::count(value);
+    }
+    std::vector<uint8_t> regs(RedisHyperLogLog::HLL_REGISTERS, 0);
+    for (const auto& key : keys) {
+        auto it = kv_store.find(key);
+        if (it == kv_store.end()) continue;
+        const std::string& value = it->second.raw();
+        if (!RedisHyperLogLog::isValid(value)) return -1;
+        RedisHyperLogLog::mergeInto(value, regs.data());
+    }
+    return RedisHyperLogLog::estimate(regs.data());
+}
+
+bool RedisDatabase::pfmerge(const std::string& dest, const std::vector<std::string>& sources) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    std::vector<uint8_t> regs(RedisHyperLogLog::HLL_REGISTERS, 0);
+    auto merge = [&](const std::string& key) {
+        auto it = kv_store.find(key);
+        if (it == kv_store.end()) return true;
+        const std::string& value = it->second.raw();
+        if (!RedisHyperLogLog::isValid(value)) return false;
+        RedisHyperLogLog::mergeInto(value, regs.data());
+        return true;
+    };
+    if (!merge(dest)) return false;
+    for (const auto& key : sources) {
+        if (!merge(key)) return false;
+    }
+    kv_store[dest] = RedisHyperLogLog::fromRegisters(regs.data());
+    slotAdd(dest);
+    signalModifiedKey(dest);
+    return true;
+}
+
+int RedisDatabase::setbit(const std::string& key, uint64_t offset, int bit) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    auto it = kv_store.find(key);
+    if (it == kv_store.end()) {
+        it = kv_store.emplace(key, std::string()).first;
+        slotAdd(key);
+    }
+    int old = RedisBitmap::setBit(it->second.raw(), offset, bit);
+    signalModifiedKey(key);
+    return old;
+}
+
+// bitmap reads use raw() too: the first one decompresses the value for good
+// instead of every call decompressing a copy under db_mutex
+int RedisDatabase::getbit(const std::string& key, uint64_t offset) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    auto it = kv_store.find(key);
+    if (it == kv_store.end()) return 0;
+    return RedisBitmap::getBit(it->second.raw(), offset);
+}
+
+uint64_t RedisDatabase::bitcount(const std::string& key, long long start, long long end, bool bitUnit) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    auto it = kv_store.find(key);
+    if (it == kv_store.end()) return 0;
+    uint64_t firstBit, lastBit;
+    if (!RedisBitmap::resolveRange(it->second.size(), start, end, bitUnit, firstBit, lastBit)) return 0;
+    return RedisBitmap::count(it->second.raw(), firstBit, lastBit);
+}
+
+long long RedisDatabase::bitpos(const std::string& key, int bit, long long start, long long end, bool hasEnd,
+                                bool bitUnit) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    auto it = kv_store.find(key);
+    // a missing key is an empty string, i.e. all zeros
+    if (it == kv_store.end()) return bit ? -1 : 0;
+    uint64_t firstBit, lastBit;
+    if (!RedisBitmap::resolveRange(it->second.size(), start, end, bitUnit, firstBit, lastBit)) return -1;
+    long long pos = RedisBitmap::position(it->second.raw(), bit, firstBit, lastBit);
+    if (pos < 0 && bit == 0 && !hasEnd) return static_cast<long long>(it->second.size()) * 8;
+    return pos;
+}
+
+size_t RedisDatabase::bitop(BitOp op, const std::string& dest, const std::vector<std::string>& sources) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    static const std::string empty;
+    std::vector<const std::string*> values;
+    for (const auto& key : sources) {
+        auto it = kv_store.find(key);
+        values.push_back(it == kv_store.end() ? &empty : &it->second.raw());
+    }
+    std::string result;
+    RedisBitmap::bitop(op, values.data(), values.size(), result);
+    // the old dest (any type) goes away, big ones on the lazy free thread
+    bool existed = detachKey(dest);
+    size_t size = result.size();
+    if (size > 0) {
+        kv_store[dest] = std::move(result);
+        slotAdd(dest);
+    }
+    if (existed || size > 0) signalModifiedKey(dest);
+    return size;
+}
+
+std::vector<std::pair<bool, int64_t>> RedisDatabase::bitfield(const std::string& key,
+                                                               const std::vector<BitfieldOp>& ops) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    std::vector<std::pair<bool, int64_t>> replies;
+    auto it = kv_store.find(key);
+    bool created = false, changed = false;
+    for (const auto& op : ops) {
+        if (it == kv_store.end()) {
+            // reads of a missing key see zeros, no need to create it
+            if (op.kind == BitfieldOp::GET) {
+                replies.emplace_back(true, 0);
+                continue;
+            }
+            it = kv_store.emplace(key, std::string()).first;
+            created = true;
+        }
+        int64_t result = 0;
+        bool done = RedisBitmap::bitfield(it->second.raw(), op, result);
+        changed |= done && op.kind != BitfieldOp::GET;
+        replies.emplace_back(done, result);
+    }
+    if (created) {
+        if (it->second.size() == 0) kv_store.erase(it); // only failed writes
+        else slotAdd(key);
+    }
+    if (changed) signalModifiedKey(key);
+    return replies;
+}
+
+/*
+ * DUMP / RESTORE payload: one type byte followed by the value
+ * K: [len][bytes]
+ * L: [count] then count x [len][bytes]
+ * H: [count] then count x [len][field][len][value]
+ * Z: [count] then count x [double score][len][member]
+ * integers are little endian uint32
+ * The snapshot file stores every value in the same encoding.
+*/
+static void putU32(std::string& out, uint32_t value) {
+    char buf[4] = {char(value), char(value >> 8), char(value >> 16), char(value >> 24)};
+    out.append(buf, 4);
+}
+static void putU64(std::string& out, uint64_t value) {
+    putU32(out, static_cast<uint32_t>(value));
+    putU32(out, static_cast<uint32_t>(value >> 32));
+}
+static void putString(std::string& out, const std::string& s) {
+    putU32(out, s.size());
+    out += s;
+}
+static bool getU32(const char* in, size_t size, size_t& pos, uint32_t& value) {
+    if (pos + 4 > size) return false;
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(in + pos);
+    value = p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+    pos += 4;
+    return true;
+}
+static bool getU64(const char* in, size_t size, size_t& pos, uint64_t& value) {
+    uint32_t low, high;
+    if (!getU32(in, size, pos, low) || !getU32(in, size, pos, high)) return false;
+    value = (uint64_t(high) << 32) | low;
+    return true;
+}
+static bool getString(const char* in, size_t size, size_t& pos, std::string& s) {
+    uint32_t len;
+    if (!getU32(in, size, pos, len) || pos + len > size) return false;
+    s.assign(in + pos, len);
+    pos += len;
     return true;
+}
+
+// compressed values are written raw, the encoding does not depend on the threshold
+static void encodeValue(std::string& out, const RedisString& str) {
+    std::string scratch;
+    out += 'K';
+    putString(out, str.view(scratch));
+}
+static void encodeValue(std::string& out, const std::vector<RedisString>& list) {
+    std::string scratch;
+    out += 'L';
+    putU32(out, list.size());
+    for (const auto& item : list) putString(out, item.view(scratch));
+}
+static void encodeValue(std::string& out, const std::unordered_map<std::string, std::string>& hash) {
+    out += 'H';
+    putU32(out, hash.size());
+    for (const auto& field_val : hash) {
+        putString(out, field_val.first);
+        putString(out, field_val.second);
+    }
+}
+static void encodeValue(std::string& out, const RedisSortedSet& zset) {
+    out += 'Z';
+    putU32(out, zset.size());
+    for (const auto& member : zset.rangeByRank(0, zset.size() - 1, false)) {
+        char score[sizeof(double)];
+        memcpy(score, &member.second, sizeof(double));
+        out.append(score, sizeof(double));
+        putString(out, member.first);
+    }
+}
+
+// a decoded value, before it is moved into the store of its type.
+// Strings and list elements come out compressed where the threshold says so
+struct DecodedValue {
+    char type = 0;
+    RedisString str;
+    std::vector<RedisString> list;
+    std::unordered_map<std::string, std::string> hash;
+    RedisSortedSet zset;
 };
 
+static bool decodeValue(const char* in, size_t size, size_t& pos, DecodedValue& value) {
+    uint32_t count = 0;
+    if (pos >= size) return false;
+    value.type = in[pos++];
+    if (value.type == 'K') {
+        std::string str;
+        if (!getString(in, size, pos, str)) return false;
+        value.str = std::move(str);
+        value.str.compress();
+        return true;
+    }
+    if (!getU32(in, size, pos, count)) return false;
+    if (value.type == 'L') {
+        value.list.reserve(std::min<size_t>(count, (size - pos) / 4));
+        for (uint32_t i = 0; i < count; i++) {
+            std::string item;
+            if (!getString(in, size, pos, item)) return false;
+            value.list.push_back(std::move(item));
+        }
+        compressListInterior(value.list);
+    } else if (value.type == 'H') {
+        value.hash.reserve(std::min<size_t>(count, (size - pos) / 8));
+        for (uint32_t i = 0; i < count; i++) {
+            std::string field, val;
+            if (!getString(in, size, pos, field) || !getString(in, size, pos, val)) return false;
+            value.hash[std::move(field)] = std::move(val);
+        }
+    } else if (value.type == 'Z') {
+        for (uint32_t i = 0; i < count; i++) {
+            double score;
+            std::string member;
+            if (pos + sizeof(double) > size) return false;
+            memcpy(&score, in + pos, sizeof(double));
+            pos += sizeof(double);
+            if (!getString(in, size, pos, member)) return false;
+            ZAddResult result;
+            value.zset.add(member, score, 0, result, score);
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
 
+bool RedisDatabase::dumpKey(const std::string& key, std::string& payload) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    return encodeKey(key, payload);
+}
 
+bool RedisDatabase::dumpKey(const std::string& key, std::string& payload, long long& ttlMs) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    if (!encodeKey(key, payload)) return false;
+    ttlMs = 0;
+    auto it = expire_store.find(key);
+    if (it != expire_store.end()) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(it->second - std::chrono::steady_clock::now());
+        ttlMs = std::max<long long>(1, left.count());
+    }
+    return true;
+}
 
+bool RedisDatabase::unlinkIfUnchanged(const std::string& key, const std::string& payload) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    std::string current;
+    if (!encodeKey(key, current) || current != payload) return false;
+    detachKey(key);
+    signalModifiedKey(key);
+    return true;
+}
+
+bool RedisDatabase::encodeKey(const std::string& key, std::string& payload) {
+    payload.clear();
+    auto itKv = kv_store.find(key);
+    if (itKv != kv_store.end()) {
+        encodeValue(payload, itKv->second);
+        return true;
+    }
+    auto itList = list_store.find(key);
+    if (itList != list_store.end()) {
+        encodeValue(payload, itList->second);
+        return true;
+    }
+    auto itHash = hash_store.find(key);
+    if (itHash != hash_store.end()) {
+        encodeValue(payload, itHash->second);
+        return true;
+    }
+    auto itZset = zset_store.find(key);
+    if (itZset != zset_store.end()) {
+        encodeValue(payload, itZset->second);
+        return true;
+    }
+    return false;
+}
 
+bool RedisDatabase::restoreKey(const std::string& key, const std::string& payload, long long ttlMs, bool replace,
+                               std::string& error) {
+    // decode before taking the lock
+    size_t pos = 0;
+    DecodedValue value;
+    if (!decodeValue(payload.data(), payload.size(), pos, value) || pos != payload.size()) {
+        error = "-ERR DUMP payload version or checksum are wrong";
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(db_mutex);
+    if (keyExists(key)) {
+        if (!replace) {
+            error = "-BUSYKEY Target key name already exists.";
+            return false;
+        }
+        detachKey(key);
+    }
+    if (value.type == 'K') kv_store[key] = std::move(value.str);
+    else if (value.type == 'L') list_store[key] = std::move(value.list);
+    else if (value.type == 'H') hash_store[key] = std::move(value.hash);
+    else zset_store[key] = std::move(value.zset);
+    if (ttlMs > 0) {
+        expire_store[key] = std::chrono::steady_clock::now() + std::chrono::milliseconds(ttlMs);
+    }
+    slotAdd(key);
+    signalModifiedKey(key);
+    return true;
+}
+
+/*
+ * Cluster slot index
+*/
+long long RedisDatabase::memoryUsage(const std::string& key, size_t samples) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    long long bytes;
+    if (measureKey(kv_store, key, samples, bytes) || measureKey(list_store, key, samples, bytes) ||
+        measureKey(hash_store, key, samples, bytes) || measureKey(zset_store, key, samples, bytes)) {
+        return bytes;
+    }
+    return -1;
+}
+
+bool RedisDatabase::scanKeySizes(KeyScanCursor& cursor, size_t buckets, size_t samples,
+                                 const KeySizeVisitor& visit) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    bool storeDone;
+    switch (cursor.store) {
+        case 0: storeDone = scanStore(kv_store, "string", cursor, buckets, samples, visit); break;
+        case 1: storeDone = scanStore(list_store, "list", cursor, buckets, samples, visit); break;
+        case 2: storeDone = scanStore(hash_store, "hash", cursor, buckets, samples, visit); break;
+        case 3: storeDone = scanStore(zset_store, "zset", cursor, buckets, samples, visit); break;
+        default: return false;
+    }
+    if (storeDone) {
+        cursor.store++;
+        cursor.bucket = 0;
+    }
+    return cursor.store < 4;
+}
+
+void RedisDatabase::enableSlotIndex() {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    if (!slot_keys.empty()) return;
+    slot_keys.assign(RedisCluster::CLUSTER_SLOTS, {});
+    for (const auto& kv : kv_store) slotAdd(kv.first);
+    for (const auto& kv : list_store) slotAdd(kv.first);
+    for (const auto& kv : hash_store) slotAdd(kv.first);
+    for (const auto& kv : zset_store) slotAdd(kv.first);
+}
+
+void RedisDatabase::signalModifiedKey(const std::string& key) {
+    RedisReadCache::getInstance().invalidate(key);
+    RedisTracking::getInstance().invalidateKey(key);
+}
+
+void RedisDatabase::slotAdd(const std::string& key) {
+    if (slot_keys.empty()) return;
+    slot_keys[RedisCluster::keyHashSlot(key)].insert(key);
+}
+
+void RedisDatabase::slotRemove(const std::string& key) {
+    if (slot_keys.empty() || keyExists(key)) return;
+    slot_keys[RedisCluster::keyHashSlot(key)].erase(key);
+}
+
+size_t RedisDatabase::countKeysInSlot(int slot) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    if (slot_keys.empty()) return 0;
+    return slot_keys[slot].size();
+}
+
+std::vector<std::string> RedisDatabase::getKeysInSlot(int slot, size_t count) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    std::vector<std::string> result;
+    if (slot_keys.empty()) return result;
+    for (const auto& key : slot_keys[slot]) {
+        if (result.size() >= count) break;
+        result.push_back(key);
+    }
+    return result;
+}
 
 /*
  * Memory -> File - dump()
  * File -> Memory - load()
- * k = kv, l = lists, h = hashes
+ * "MYRDB002", then segments of records [key][u64 expire at, unix ms, 0 = none][value payload],
+ * then the footer index: [u32 segments] + segments x [u64 offset][u64 size][u32 keys],
+ * [u64 footer offset] and "MYRDBEND".
+ * Segments decode independently, so load() spreads them over all cores.
+ * Files without the header use the old text format: k = kv, l = lists, h = hashes, z = sorted sets
 */
+static const char SNAPSHOT_MAGIC[] = "MYRDB002";
+static const char SNAPSHOT_END[] = "MYRDBEND";
+static const size_t SNAPSHOT_MAGIC_LEN = 8;
+static const size_t SNAPSHOT_SEGMENT_BYTES = 4 * 1024 * 1024;
+
+struct SnapshotSegment {
+    uint64_t offset;
+    uint64_t size;
+    uint32_t keys;
+};
+
 bool RedisDatabase::dump(const std::string& filename) {
     std::lock_guard<std::mutex> lock(db_mutex);
-    std::ofstream ofs(filename, std::ios::binary);
+    // written aside and renamed, so a crash never leaves a truncated snapshot behind
+    std::string tmpname = filename + ".tmp";
+    std::ofstream ofs(tmpname, std::ios::binary | std::ios::trunc);
     if (!ofs) return false;
+    ofs.write(SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LEN);
 
-    for (const auto& kv : kv_store) {
-        ofs << "K" << kv.first << " " << kv.second << "\n";
+    auto nowSteady = std::chrono::steady_clock::now();
+    auto nowSystem = std::chrono::system_clock::now();
+    std::vector<SnapshotSegment> index;
+    std::string segment;
+    uint32_t keys = 0;
+    uint64_t offset = SNAPSHOT_MAGIC_LEN;
+    auto flushSegment = [&]() {
+        if (keys == 0) return;
+        ofs.write(segment.data(), segment.size());
+        index.push_back({offset, segment.size(), keys});
+        offset += segment.size();
+        segment.clear();
+        keys = 0;
+    };
+    auto record = [&](const std::string& key, const auto& value) {
+        uint64_t expireAt = 0;
+        auto it = expire_store.find(key);
+        if (it != expire_store.end()) {
+            auto at = nowSystem + std::chrono::duration_cast<std::chrono::system_clock::duration>(it->second - nowSteady);
+            expireAt = std::max<int64_t>(1, std::chrono::duration_cast<std::chrono::milliseconds>(
+                at.time_since_epoch()).count());
+        }
+        putString(segment, key);
+        putU64(segment, expireAt);
+        encodeValue(segment, value);
+        keys++;
+        if (segment.size() >= SNAPSHOT_SEGMENT_BYTES) flushSegment();
+    };
+    for (const auto& kv : kv_store) record(kv.first, kv.second);
+    for (const auto& kv : list_store) record(kv.first, kv.second);
+    for (const auto& kv : hash_store) record(kv.first, kv.second);
+    for (const auto& kv : zset_store) record(kv.first, kv.second);
+    flushSegment();
+
+    std::string footer;
+    putU32(footer, index.size());
+    for (const auto& entry : index) {
+        putU64(footer, entry.offset);
+        putU64(footer, entry.size);
+        putU32(footer, entry.keys);
     }
-    for (const auto& kv : list_store) {
-        ofs << "L " << kv.first;
-        for (const auto& item : kv.second) {
-            ofs << " " << item;
+    putU64(footer, offset);
+    footer.append(SNAPSHOT_END, SNAPSHOT_MAGIC_LEN);
+    ofs.write(footer.data(), footer.size());
+    ofs.close();
+    if (!ofs) return false;
+    return std::rename(tmpname.c_str(), filename.c_str()) == 0;
+}
+
+// slot index sets are filled by all load workers, each stripe under its own lock
+static const size_t SNAPSHOT_SLOT_STRIPES = 64;
+
+// keys of the segment a load worker just decoded, with their expire times and,
+// in cluster mode, their hash slots grouped by stripe
+struct SnapshotShard {
+    std::unordered_map<std::string, RedisString> kv;
+    std::unordered_map<std::string, std::vector<RedisString>> lists;
+    std::unordered_map<std::string, std::unordered_map<std::string, std::string>> hashes;
+    std::unordered_map<std::string, RedisSortedSet> zsets;
+    std::unordered_map<std::string, std::chrono::steady_clock::time_point> expires;
+    std::vector<std::vector<std::pair<int, std::string>>> slotted;
+};
+
+// expire times are unix ms in the file and steady_clock in expire_store
+struct SnapshotClock {
+    std::chrono::steady_clock::time_point steady;
+    int64_t unixMs;
+};
+
+static bool decodeSegment(const char* data, const SnapshotSegment& segment, const SnapshotClock& now,
+                          SnapshotShard& shard) {
+    const char* in = data + segment.offset;
+    size_t size = segment.size, pos = 0;
+    for (uint32_t i = 0; i < segment.keys; i++) {
+        std::string key;
+        uint64_t expireAt;
+        DecodedValue value;
+        if (!getString(in, size, pos, key) || !getU64(in, size, pos, expireAt) ||
+            !decodeValue(in, size, pos, value)) {
+            return false;
+        }
+        // keys already past their time are left to the active expire cycle
+        if (expireAt != 0) shard.expires.emplace(key, now.steady + std::chrono::milliseconds(int64_t(expireAt) - now.unixMs));
+        if (!shard.slotted.empty()) {
+            int slot = RedisCluster::keyHashSlot(key);
+            shard.slotted[slot % SNAPSHOT_SLOT_STRIPES].emplace_back(slot, key);
         }
-        ofs << "\n";
+        if (value.type == 'K') shard.kv.emplace(std::move(key), std::move(value.str));
+        else if (value.type == 'L') shard.lists.emplace(std::move(key), std::move(value.list));
+        else if (value.type == 'H') shard.hashes.emplace(std::move(key), std::move(value.hash));
+        else shard.zsets.emplace(std::move(key), std::move(value.zset));
     }
-    for (const auto& kv : hash_store) {
-        ofs << "H " << kv.first;
-        for (const auto& field_val : kv.second) {
-            ofs << " " << field_val.first << ":" << field_val.second;
+    return pos == size;
+}
+
+static bool readSnapshotIndex(const char* data, size_t size, std::vector<SnapshotSegment>& index) {
+    if (size < 2 * SNAPSHOT_MAGIC_LEN + 8 || memcmp(data + size - SNAPSHOT_MAGIC_LEN, SNAPSHOT_END, SNAPSHOT_MAGIC_LEN) != 0) {
+        return false;
+    }
+    size_t pos = size - SNAPSHOT_MAGIC_LEN - 8;
+    uint64_t footer;
+    uint32_t count;
+    if (!getU64(data, size, pos, footer) || footer < SNAPSHOT_MAGIC_LEN || footer > size) return false;
+    pos = footer;
+    if (!getU32(data, size, pos, count)) return false;
+    for (uint32_t i = 0; i < count; i++) {
+        SnapshotSegment segment;
+        if (!getU64(data, size, pos, segment.offset) || !getU64(data, size, pos, segment.size) ||
+            !getU32(data, size, pos, segment.keys)) {
+            return false;
         }
-        ofs << "\n";
+        if (segment.offset < SNAPSHOT_MAGIC_LEN || segment.offset + segment.size > footer) return false;
+        index.push_back(segment);
     }
     return true;
 }
 
 bool RedisDatabase::load(const std::string& filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    char magic[SNAPSHOT_MAGIC_LEN];
+    struct stat st;
+    if (pread(fd, magic, SNAPSHOT_MAGIC_LEN, 0) != (ssize_t)SNAPSHOT_MAGIC_LEN ||
+        memcmp(magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LEN) != 0 || fstat(fd, &st) != 0) {
+        close(fd);
+        std::ifstream ifs(filename, std::ios::binary);
+        return ifs && loadText(ifs);
+    }
+    // mapped rather than read, so workers fault in only the segments they claim
+    size_t size = st.st_size;
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+    bool ok = loadSnapshot(static_cast<const char*>(data), size);
+    munmap(data, size);
+    return ok;
+}
+
+bool RedisDatabase::loadSnapshot(const char* data, size_t size) {
+    std::vector<SnapshotSegment> index;
+    if (!readSnapshotIndex(data, size, index)) return false;
+
     std::lock_guard<std::mutex> lock(db_mutex);
-    std::ifstream ifs(filename, std::ios::binary);
-    if (ifs) return false;
+    RedisReadCache::getInstance().clear();
+    kv_store.clear();
+    list_store.clear();
+    hash_store.clear();
+    zset_store.clear();
+    expire_store.clear();
+    for (auto& keys : slot_keys) keys.clear();
 
+    // Each worker claims segments, decodes one into its own shard without any
+    // lock, then splices the shard into the stores (relinking nodes, no copies)
+    // under the lock of each store. Splicing is serial per store, but overlaps
+    // with the decoding done by the other workers.
+    SnapshotClock now{std::chrono::steady_clock::now(), std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count()};
+    std::mutex kvMutex, listMutex, hashMutex, zsetMutex, expireMutex;
+    std::vector<std::mutex> slotMutex(slot_keys.empty() ? 0 : SNAPSHOT_SLOT_STRIPES);
+    auto splice = [](std::mutex& mutex, auto& store, auto& table) {
+        if (table.empty()) return;
+        std::lock_guard<std::mutex> storeLock(mutex);
+        store.merge(table);
+    };
+    size_t workers = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), index.size()));
+    std::atomic<size_t> next(0);
+    std::atomic<bool> ok(true);
+    std::vector<std::thread> threads;
+    for (size_t w = 0; w < workers; w++) {
+        threads.emplace_back([&]() {
+            SnapshotShard shard;
+            shard.slotted.resize(slotMutex.size());
+            for (size_t i = next++; i < index.size() && ok; i = next++) {
+                if (!decodeSegment(data, index[i], now, shard)) {
+                    ok = false;
+                    return;
+                }
+                splice(kvMutex, kv_store, shard.kv);
+                splice(listMutex, list_store, shard.lists);
+                splice(hashMutex, hash_store, shard.hashes);
+                splice(zsetMutex, zset_store, shard.zsets);
+                splice(expireMutex, expire_store, shard.expires);
+                for (size_t s = 0; s < shard.slotted.size(); s++) {
+                    if (shard.slotted[s].empty()) continue;
+                    std::lock_guard<std::mutex> slotLock(slotMutex[s]);
+                    for (auto& entry : shard.slotted[s]) slot_keys[entry.first].insert(std::move(entry.second));
+                    shard.slotted[s].clear();
+                }
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    if (ok) return true;
+
+    // a corrupt segment leaves the database empty rather than half loaded
     kv_store.clear();
     list_store.clear();
     hash_store.clear();
+    zset_store.clear();
+    expire_store.clear();
+    for (auto& keys : slot_keys) keys.clear();
+    return false;
+}
+
+bool RedisDatabase::loadText(std::istream& ifs) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    RedisReadCache::getInstance().clear();
+    kv_store.clear();
+    list_store.clear();
+    hash_store.clear();
+    zset_store.clear();
 
     std::string line;
     while (std::getline(ifs, line)) {
@@ -354,7 +1381,7 @@ bool RedisDatabase::load(const std::string& filename) {
         } else if (type == 'L') {
             std::string key;
             iss >> key;
-            std::vector<std::string> list;
+            std::vector<RedisString> list;
             std::string item;
             while (iss >> item) {
                 list.push_back(item);
@@ -374,6 +1401,20 @@ bool RedisDatabase::load(const std::string& filename) {
                 }
             }
             hash_store[key] = hash;
+        } else if (type == 'Z') {
+            std::string key;
+            iss >> key;
+            RedisSortedSet zset;
+            std::string pair;
+            while (iss >> pair) {
+                auto pos = pair.find(":");
+                double score;
+                if (pos != std::string::npos && RedisSortedSet::parseScore(pair.substr(0, pos), score)) {
+                    ZAddResult result;
+                    zset.add(pair.substr(pos+1), score, 0, result, score);
+                }
+            }
+            zset_store[key] = std::move(zset);
         }
     }
     return true;
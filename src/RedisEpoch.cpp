@@ -0,0 +1,81 @@
+#include "../include/RedisEpoch.h"
+
+#include <algorithm>
+
+RedisEpoch& RedisEpoch::getInstance() {
+    static RedisEpoch instance;
+    return instance;
+}
+
+RedisEpoch::ThreadRecord* RedisEpoch::localRecord() {
+    struct Owner {
+        ThreadRecord* record = nullptr;
+        ~Owner() {
+            if (record) record->in_use.store(false, std::memory_order_release);
+        }
+    };
+    thread_local Owner owner;
+    if (owner.record) return owner.record;
+
+    // reuse the record of a thread that exited, or add one
+    for (ThreadRecord* r = records.load(std::memory_order_acquire); r; r = r->next) {
+        bool expected = false;
+        if (!r->in_use.load(std::memory_order_relaxed) &&
+            r->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            owner.record = r;
+            return r;
+        }
+    }
+    ThreadRecord* r = new ThreadRecord();
+    r->in_use.store(true, std::memory_order_relaxed);
+    r->next = records.load(std::memory_order_relaxed);
+    while (!records.compare_exchange_weak(r->next, r, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+    owner.record = r;
+    return r;
+}
+
+RedisEpoch::Guard::Guard() {
+    RedisEpoch& epoch = RedisEpoch::getInstance();
+    record = epoch.localRecord();
+    record->epoch.store(epoch.global_epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+    // the pin must be visible before any shared pointer is read
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+RedisEpoch::Guard::~Guard() {
+    record->epoch.store(0, std::memory_order_release);
+}
+
+bool RedisEpoch::tryAdvance() {
+    uint64_t current = global_epoch.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (ThreadRecord* r = records.load(std::memory_order_acquire); r; r = r->next) {
+        uint64_t pinned = r->epoch.load(std::memory_order_acquire);
+        if (pinned != 0 && pinned != current) return false;
+    }
+    return global_epoch.compare_exchange_strong(current, current + 1, std::memory_order_acq_rel);
+}
+
+void RedisEpoch::retire(void* object, void (*deleter)(void*)) {
+    std::vector<Retired> ready;
+    {
+        std::lock_guard<std::mutex> lock(retire_mutex);
+        limbo.push_back({global_epoch.load(std::memory_order_acquire), object, deleter});
+        if (++retired_since_collect < COLLECT_BATCH) return;
+        retired_since_collect = 0;
+        tryAdvance();
+        // two epochs later no pinned thread can still reach it
+        uint64_t current = global_epoch.load(std::memory_order_acquire);
+        auto keep = std::partition(limbo.begin(), limbo.end(),
+                                   [current](const Retired& r) { return r.epoch + 2 > current; });
+        ready.assign(keep, limbo.end());
+        limbo.erase(keep, limbo.end());
+    }
+    for (const auto& r : ready) r.deleter(r.object);
+}
+
+size_t RedisEpoch::pending() {
+    std::lock_guard<std::mutex> lock(retire_mutex);
+    return limbo.size();
+}
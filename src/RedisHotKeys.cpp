@@ -0,0 +1,108 @@
+#include "../include/RedisHotKeys.h"
+
+#include <algorithm>
+#include <functional>
+
+RedisHotKeys& RedisHotKeys::getInstance() {
+    static RedisHotKeys instance;
+    return instance;
+}
+
+RedisHotKeys::RedisHotKeys() : sketch(SKETCH_DEPTH * SKETCH_WIDTH), started(std::chrono::steady_clock::now()) {}
+
+uint32_t RedisHotKeys::seed() {
+    // splitmix64 of a per thread sequence number and the clock
+    uint64_t z = (seeds.fetch_add(1, std::memory_order_relaxed) + 1) * 0x9e3779b97f4a7c15ULL +
+        static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    uint32_t seed = static_cast<uint32_t>(z ^ (z >> 32));
+    return seed ? seed : 1;
+}
+
+uint32_t RedisHotKeys::increment(const std::string& key) {
+    // row i uses h1 + i * h2 (double hashing) from a single key hash
+    uint64_t hash = std::hash<std::string>()(key);
+    uint32_t h1 = static_cast<uint32_t>(hash), h2 = static_cast<uint32_t>(hash >> 32) | 1;
+    uint32_t estimate = UINT32_MAX;
+    for (int row = 0; row < SKETCH_DEPTH; row++) {
+        size_t column = (h1 + row * h2) & (SKETCH_WIDTH - 1);
+        uint32_t count = sketch[row * SKETCH_WIDTH + column].fetch_add(1, std::memory_order_relaxed) + 1;
+        estimate = std::min(estimate, count);
+    }
+    return estimate;
+}
+
+void RedisHotKeys::record(const std::vector<std::string>& keys) {
+    if (keys.empty()) return;
+    decayIfDue();
+    for (const auto& key : keys) {
+        uint32_t estimate = increment(key);
+        if (estimate < admit_count.load(std::memory_order_relaxed)) continue;
+
+        std::lock_guard<std::mutex> lock(top_mutex);
+        top_keys[key] = estimate;
+        if (top_keys.size() <= HOTKEYS_MAX_COUNT) continue;
+        // full: drop the coldest candidate, the next one sets the bar
+        auto coldest = std::min_element(top_keys.begin(), top_keys.end(),
+                                        [](const auto& a, const auto& b) { return a.second < b.second; });
+        top_keys.erase(coldest);
+        coldest = std::min_element(top_keys.begin(), top_keys.end(),
+                                   [](const auto& a, const auto& b) { return a.second < b.second; });
+        admit_count = coldest->second + 1;
+    }
+}
+
+void RedisHotKeys::decayIfDue() {
+    const int64_t period = HOTKEYS_DECAY_SECONDS * 1000;
+    int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started)
+        .count();
+    int64_t last = last_decay_ms.load(std::memory_order_relaxed);
+    int64_t periods = (now - last) / period;
+    if (periods == 0) return;
+    // one thread wins and halves everything once per period that went by
+    // (idle time included); increments racing with it may be lost
+    if (!last_decay_ms.compare_exchange_strong(last, last + periods * period)) return;
+    int shift = static_cast<int>(std::min<int64_t>(periods, 31));
+    for (auto& counter : sketch) {
+        counter.store(counter.load(std::memory_order_relaxed) >> shift, std::memory_order_relaxed);
+    }
+
+    std::lock_guard<std::mutex> lock(top_mutex);
+    for (auto it = top_keys.begin(); it != top_keys.end();) {
+        it->second >>= shift;
+        if (it->second == 0) it = top_keys.erase(it);
+        else ++it;
+    }
+    admit_count = top_keys.size() < HOTKEYS_MAX_COUNT ? 1 : std::max<uint32_t>(1, admit_count >> shift);
+    decays++;
+}
+
+double RedisHotKeys::rate(uint32_t count) const {
+    // at a steady rate, a count halved every period is a * (1 + f) where a is
+    // the samples of one period and f how far the current period has gone
+    int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started)
+        .count();
+    double period = HOTKEYS_DECAY_SECONDS;
+    double elapsed = (now - last_decay_ms.load()) / (period * 1000);
+    // before the first decay there is no older history
+    if (decays == 0) return count * HOTKEYS_SAMPLE_RATE / std::max(0.001, elapsed * period);
+    return count * HOTKEYS_SAMPLE_RATE / (period * (1 + elapsed));
+}
+
+std::vector<std::pair<std::string, uint64_t>> RedisHotKeys::top(size_t count) {
+    decayIfDue();
+    std::vector<std::pair<std::string, uint32_t>> keys;
+    {
+        std::lock_guard<std::mutex> lock(top_mutex);
+        keys.assign(top_keys.begin(), top_keys.end());
+    }
+    std::sort(keys.begin(), keys.end(), [](const auto& a, const auto& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+    if (keys.size() > count) keys.resize(count);
+    std::vector<std::pair<std::string, uint64_t>> result;
+    for (const auto& key : keys) result.emplace_back(key.first, static_cast<uint64_t>(rate(key.second)));
+    return result;
+}
@@ -0,0 +1,393 @@
+#include "../include/RedisHyperLogLog.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HLL_HAVE_AVX2 1
+#endif
+
+static const char HLL_MAGIC[] = "HYLL";
+static const char HLL_DENSE = 0;
+static const char HLL_SPARSE = 1;
+static const double HLL_ALPHA_INF = 0.721347520444481703680; // 1 / (2 ln 2)
+
+// Sparse opcodes
+// ZERO  00xxxxxx          : xxxxxx + 1 (1-64) zero registers
+// XZERO 01xxxxxx yyyyyyyy : xxxxxxyyyyyyyy + 1 (1-16384) zero registers
+// VAL   1vvvvvxx          : xx + 1 (1-4) registers set to vvvvv + 1 (1-32)
+static const uint8_t HLL_SPARSE_XZERO_BIT = 0x40;
+static const uint8_t HLL_SPARSE_VAL_BIT = 0x80;
+static const int HLL_SPARSE_ZERO_MAX_LEN = 64;
+static const int HLL_SPARSE_XZERO_MAX_LEN = 16384;
+static const int HLL_SPARSE_VAL_MAX_LEN = 4;
+
+// MurmurHash2, 64-bit version (same hash and seed as Redis, so values are interchangeable)
+static uint64_t murmurHash64A(const void* key, size_t len, uint64_t seed) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    uint64_t h = seed ^ (len * m);
+    const uint8_t* data = static_cast<const uint8_t*>(key);
+    const uint8_t* end = data + (len - (len & 7));
+    while (data != end) {
+        uint64_t k;
+        memcpy(&k, data, sizeof(k)); // little endian hosts only, like the rest of the payload encodings
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+        data += 8;
+    }
+    switch (len & 7) {
+        case 7: h ^= uint64_t(data[6]) << 48; // fallthrough
+        case 6: h ^= uint64_t(data[5]) << 40; // fallthrough
+        case 5: h ^= uint64_t(data[4]) << 32; // fallthrough
+        case 4: h ^= uint64_t(data[3]) << 24; // fallthrough
+        case 3: h ^= uint64_t(data[2]) << 16; // fallthrough
+        case 2: h ^= uint64_t(data[1]) << 8;  // fallthrough
+        case 1:
+            h ^= uint64_t(data[0]);
+            h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+/*
+ * Dense registers: register i is stored at bit i * 6, least significant bits first
+*/
+static uint8_t denseGet(const uint8_t* p, long index) {
+    size_t byte = index * 6 / 8;
+    unsigned fb = index * 6 & 7;
+    unsigned value = p[byte] >> fb;
+    if (fb > 2) value |= p[byte + 1] << (8 - fb);
+    return value & 63;
+}
+
+static void densePut(uint8_t* p, long index, uint8_t value) {
+    size_t byte = index * 6 / 8;
+    unsigned fb = index * 6 & 7;
+    p[byte] = static_cast<uint8_t>((p[byte] & ~(63 << fb)) | (value << fb));
+    if (fb > 2) p[byte + 1] = static_cast<uint8_t>((p[byte + 1] & ~(63 >> (8 - fb))) | (value >> (8 - fb)));
+}
+
+// 3 packed bytes hold 4 registers
+static void denseMergeScalar(uint8_t* regs, const uint8_t* p, int from) {
+    for (int i = from; i < RedisHyperLogLog::HLL_REGISTERS; i += 4) {
+        const uint8_t* group = p + i / 4 * 3;
+        uint32_t word = group[0] | (group[1] << 8) | (group[2] << 16);
+        for (int k = 0; k < 4; k++, word >>= 6) {
+            uint8_t value = word & 63;
+            if (value > regs[i + k]) regs[i + k] = value;
+        }
+    }
+}
+
+static const double* negativePowersOfTwo() {
+    static double table[64];
+    static bool init = [] {
+        for (int i = 0; i < 64; i++) table[i] = std::ldexp(1.0, -i);
+        return true;
+    }();
+    (void)init;
+    return table;
+}
+
+// sum of 2^-regs[i] and the number of registers equal to 0 and to Q + 1
+static void registerSumsScalar(const uint8_t* regs, double& sum, int& zeros, int& full) {
+    const double* pow2 = negativePowersOfTwo();
+    sum = 0;
+    zeros = full = 0;
+    for (int i = 0; i < RedisHyperLogLog::HLL_REGISTERS; i++) {
+        sum += pow2[regs[i]];
+        zeros += regs[i] == 0;
+        full += regs[i] == RedisHyperLogLog::HLL_Q + 1;
+    }
+}
+
+#ifdef HLL_HAVE_AVX2
+// 32 registers (24 packed bytes) per step. The load starts 4 bytes early
+// (inside the header) so each 128-bit lane holds 4 groups of 3 bytes, which
+// the shuffle spreads to one group per 32-bit word; shifts then move each
+// 6-bit register to its own byte.
+__attribute__((target("avx2")))
+static void denseMergeAVX2(uint8_t* regs, const uint8_t* p) {
+    const __m256i shuffle = _mm256_setr_epi8(4, 5, 6, -1, 7, 8, 9, -1, 10, 11, 12, -1, 13, 14, 15, -1,
+                                             0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i mask0 = _mm256_set1_epi32(0x3f);
+    const __m256i mask1 = _mm256_set1_epi32(0x3f00);
+    const __m256i mask2 = _mm256_set1_epi32(0x3f0000);
+    const __m256i mask3 = _mm256_set1_epi32(0x3f000000);
+    const size_t packed = RedisHyperLogLog::HLL_DENSE_SIZE - RedisHyperLogLog::HLL_HDR_SIZE;
+    int i = 0;
+    // stop while the 32 byte load still ends inside the registers
+    for (; i / 32 * 24 + 28 <= static_cast<int>(packed); i += 32) {
+        __m256i words = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i / 32 * 24 - 4));
+        words = _mm256_shuffle_epi8(words, shuffle);
+        __m256i values = _mm256_or_si256(
+            _mm256_or_si256(_mm256_and_si256(words, mask0), _mm256_and_si256(_mm256_slli_epi32(words, 2), mask1)),
+            _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(words, 4), mask2),
+                            _mm256_and_si256(_mm256_slli_epi32(words, 6), mask3)));
+        __m256i current = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(regs + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(regs + i), _mm256_max_epu8(current, values));
+    }
+    denseMergeScalar(regs, p, i);
+}
+
+// 2^-r is built directly as a double: exponent field 1023 - r, zero mantissa
+__attribute__((target("avx2")))
+static void registerSumsAVX2(const uint8_t* regs, double& sum, int& zeros, int& full) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i top = _mm256_set1_epi8(RedisHyperLogLog::HLL_Q + 1);
+    const __m256i bias = _mm256_set1_epi64x(1023);
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    zeros = full = 0;
+    for (int i = 0; i < RedisHyperLogLog::HLL_REGISTERS; i += 32) {
+        __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(regs + i));
+        zeros += __builtin_popcount(_mm256_movemask_epi8(_mm256_cmpeq_epi8(values, zero)));
+        full += __builtin_popcount(_mm256_movemask_epi8(_mm256_cmpeq_epi8(values, top)));
+        for (int k = 0; k < 32; k += 8) {
+            int32_t low, high;
+            memcpy(&low, regs + i + k, 4);
+            memcpy(&high, regs + i + k + 4, 4);
+            __m256i e0 = _mm256_sub_epi64(bias, _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(low)));
+            __m256i e1 = _mm256_sub_epi64(bias, _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(high)));
+            acc0 = _mm256_add_pd(acc0, _mm256_castsi256_pd(_mm256_slli_epi64(e0, 52)));
+            acc1 = _mm256_add_pd(acc1, _mm256_castsi256_pd(_mm256_slli_epi64(e1, 52)));
+        }
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+static bool hasAVX2() {
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+#endif
+
+static void denseMerge(uint8_t* regs, const uint8_t* p) {
+#ifdef HLL_HAVE_AVX2
+    if (hasAVX2()) return denseMergeAVX2(regs, p);
+#endif
+    denseMergeScalar(regs, p, 0);
+}
+
+static void registerSums(const uint8_t* regs, double& sum, int& zeros, int& full) {
+#ifdef HLL_HAVE_AVX2
+    if (hasAVX2()) return registerSumsAVX2(regs, sum, zeros, full);
+#endif
+    registerSumsScalar(regs, sum, zeros, full);
+}
+
+static std::string header(char encoding) {
+    std::string hll(RedisHyperLogLog::HLL_HDR_SIZE, '\0');
+    memcpy(&hll[0], HLL_MAGIC, 4);
+    hll[4] = encoding;
+    return hll;
+}
+
+/*
+ * RedisHyperLogLog
+*/
+std::string RedisHyperLogLog::create() {
+    // one XZERO covering every register; cached cardinality 0 is valid
+    std::string hll = header(HLL_SPARSE);
+    hll += static_cast<char>(HLL_SPARSE_XZERO_BIT | ((HLL_REGISTERS - 1) >> 8));
+    hll += static_cast<char>((HLL_REGISTERS - 1) & 0xff);
+    return hll;
+}
+
+bool RedisHyperLogLog::isValid(const std::string& hll) {
+    if (hll.size() < HLL_HDR_SIZE || memcmp(hll.data(), HLL_MAGIC, 4) != 0) return false;
+    if (hll[4] == HLL_DENSE) return hll.size() == HLL_DENSE_SIZE;
+    if (hll[4] == HLL_SPARSE) return sparseToRegisters(hll.data() + HLL_HDR_SIZE, hll.size() - HLL_HDR_SIZE, nullptr);
+    return false;
+}
+
+int RedisHyperLogLog::patLen(const std::string& element, long& index) {
+    uint64_t hash = murmurHash64A(element.data(), element.size(), 0xadc83b19ULL);
+    index = hash & (HLL_REGISTERS - 1);
+    hash >>= HLL_P;
+    hash |= 1ULL << HLL_Q; // bounds the count to Q + 1
+    return __builtin_ctzll(hash) + 1;
+}
+
+bool RedisHyperLogLog::denseSet(std::string& hll, long index, uint8_t count) {
+    uint8_t* p = reinterpret_cast<uint8_t*>(&hll[HLL_HDR_SIZE]);
+    if (count <= denseGet(p, index)) return false;
+    densePut(p, index, count);
+    return true;
+}
+
+bool RedisHyperLogLog::sparseToRegisters(const char* p, size_t size, uint8_t* regs) {
+    const uint8_t* op = reinterpret_cast<const uint8_t*>(p);
+    const uint8_t* end = op + size;
+    long index = 0;
+    while (op < end) {
+        long len;
+        uint8_t value = 0;
+        if (*op & HLL_SPARSE_VAL_BIT) {
+            value = ((*op >> 2) & 31) + 1;
+            len = (*op & 3) + 1;
+            op++;
+        } else if (*op & HLL_SPARSE_XZERO_BIT) {
+            if (op + 1 >= end) return false;
+            len = (((*op & 0x3f) << 8) | op[1]) + 1;
+            op += 2;
+        } else {
+            len = (*op & 0x3f) + 1;
+            op++;
+        }
+        if (index + len > HLL_REGISTERS) return false;
+        if (value && regs) {
+            for (long i = index; i < index + len; i++) {
+                if (value > regs[i]) regs[i] = value;
+            }
+        }
+        index += len;
+    }
+    return index == HLL_REGISTERS;
+}
+
+bool RedisHyperLogLog::add(std::string& hll, const std::vector<std::string>& elements) {
+    bool updated = false;
+    if (isSparse(hll)) {
+        // small enough to rebuild: expand, update, encode again (possibly as dense)
+        uint8_t regs[HLL_REGISTERS] = {0};
+        sparseToRegisters(hll.data() + HLL_HDR_SIZE, hll.size() - HLL_HDR_SIZE, regs);
+        for (const auto& element : elements) {
+            long index;
+            uint8_t count = patLen(element, index);
+            if (count > regs[index]) {
+                regs[index] = count;
+                updated = true;
+            }
+        }
+        if (updated) hll = fromRegisters(regs);
+        return updated;
+    }
+    for (const auto& element : elements) {
+        long index;
+        uint8_t count = patLen(element, index);
+        if (denseSet(hll, index, count)) updated = true;
+    }
+    if (updated) invalidateCache(hll);
+    return updated;
+}
+
+uint64_t RedisHyperLogLog::count(std::string& hll) {
+    uint8_t* card = reinterpret_cast<uint8_t*>(&hll[8]);
+    if (!(card[7] & 0x80)) {
+        uint64_t cached = 0;
+        for (int i = 7; i >= 0; i--) cached = (cached << 8) | card[i];
+        return cached;
+    }
+    uint8_t regs[HLL_REGISTERS] = {0};
+    mergeInto(hll, regs);
+    uint64_t cardinality = estimate(regs);
+    for (int i = 0; i < 8; i++) card[i] = static_cast<uint8_t>(cardinality >> (i * 8));
+    return cardinality;
+}
+
+void RedisHyperLogLog::mergeInto(const std::string& hll, uint8_t* regs) {
+    if (isSparse(hll)) {
+        sparseToRegisters(hll.data() + HLL_HDR_SIZE, hll.size() - HLL_HDR_SIZE, regs);
+    } else {
+        denseMerge(regs, reinterpret_cast<const uint8_t*>(hll.data() + HLL_HDR_SIZE));
+    }
+}
+
+// "New cardinality estimation algorithms for HyperLogLog sketches" (Otmar Ertl),
+// the estimator Redis uses: registers at 0 and Q + 1 get the sigma / tau
+// corrections, the others contribute 2^-r to the harmonic mean
+static double hllSigma(double x) {
+    if (x == 1.) return INFINITY;
+    double zPrime;
+    double y = 1;
+    double z = x;
+    do {
+        x *= x;
+        zPrime = z;
+        z += x * y;
+        y += y;
+    } while (zPrime != z);
+    return z;
+}
+
+static double hllTau(double x) {
+    if (x == 0. || x == 1.) return 0.;
+    double zPrime;
+    double y = 1.0;
+    double z = 1 - x;
+    do {
+        x = sqrt(x);
+        zPrime = z;
+        y *= 0.5;
+        z -= pow(1 - x, 2) * y;
+    } while (zPrime != z);
+    return z / 3;
+}
+
+uint64_t RedisHyperLogLog::estimate(const uint8_t* regs) {
+    double sum;
+    int zeros, full;
+    registerSums(regs, sum, zeros, full);
+    double m = HLL_REGISTERS;
+    // drop the 0 and Q + 1 registers from the sum, they are accounted below
+    double middle = sum - zeros - full * std::ldexp(1.0, -(HLL_Q + 1));
+    double z = m * hllTau((m - full) / m) * std::ldexp(1.0, -HLL_Q) + middle + m * hllSigma(zeros / m);
+    return static_cast<uint64_t>(llroundl(HLL_ALPHA_INF * m * m / z));
+}
+
+std::string RedisHyperLogLog::fromRegisters(const uint8_t* regs) {
+    std::string hll = header(HLL_SPARSE);
+    invalidateCache(hll);
+    bool sparse = true;
+    for (int i = 0; i < HLL_REGISTERS && sparse;) {
+        uint8_t value = regs[i];
+        int run = i + 1;
+        while (run < HLL_REGISTERS && regs[run] == value) run++;
+        int len = run - i;
+        i = run;
+        if (value > HLL_SPARSE_VAL_MAX) {
+            sparse = false;
+        } else if (value == 0) {
+            while (len > 0) {
+                int chunk = std::min(len, HLL_SPARSE_XZERO_MAX_LEN);
+                if (chunk > HLL_SPARSE_ZERO_MAX_LEN) {
+                    hll += static_cast<char>(HLL_SPARSE_XZERO_BIT | ((chunk - 1) >> 8));
+                    hll += static_cast<char>((chunk - 1) & 0xff);
+                } else {
+                    hll += static_cast<char>(chunk - 1);
+                }
+                len -= chunk;
+            }
+        } else {
+            while (len > 0) {
+                int chunk = std::min(len, HLL_SPARSE_VAL_MAX_LEN);
+                hll += static_cast<char>(HLL_SPARSE_VAL_BIT | ((value - 1) << 2) | (chunk - 1));
+                len -= chunk;
+            }
+        }
+        if (hll.size() > HLL_SPARSE_MAX_BYTES) sparse = false;
+    }
+    if (sparse) return hll;
+
+    hll = header(HLL_DENSE);
+    invalidateCache(hll);
+    hll.resize(HLL_DENSE_SIZE, '\0');
+    uint8_t* p = reinterpret_cast<uint8_t*>(&hll[HLL_HDR_SIZE]);
+    for (int i = 0; i < HLL_REGISTERS; i += 4, p += 3) {
+        uint32_t word = regs[i] | (regs[i + 1] << 6) | (regs[i + 2] << 12) | (regs[i + 3] << 18);
+        p[0] = word & 0xff;
+        p[1] = (word >> 8) & 0xff;
+        p[2] = (word >> 16) & 0xff;
+    }
+    return hll;
+}
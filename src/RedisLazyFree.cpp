@@ -0,0 +1,44 @@
+#include "../include/RedisLazyFree.h"
+
+RedisLazyFree& RedisLazyFree::getInstance() {
+    static RedisLazyFree instance;
+    return instance;
+}
+
+RedisLazyFree::RedisLazyFree() : pending_objects(0), stopping(false) {
+    thread = std::thread(&RedisLazyFree::worker, this);
+}
+
+RedisLazyFree::~RedisLazyFree() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    queue_cv.notify_one();
+    if (thread.joinable()) thread.join();
+}
+
+void RedisLazyFree::enqueue(std::shared_ptr<void> object) {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        queue.push_back(std::move(object));
+        pending_objects++;
+    }
+    queue_cv.notify_one();
+}
+
+void RedisLazyFree::worker() {
+    while (true) {
+        std::shared_ptr<void> object;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_cv.wait(lock, [this]() { return stopping || !queue.empty(); });
+            if (queue.empty()) return; // stopping and nothing left to free
+            object = std::move(queue.front());
+            queue.pop_front();
+        }
+        // the destructor of the detached value runs here, outside every lock
+        object.reset();
+        pending_objects--;
+    }
+}
@@ -0,0 +1,243 @@
+#include "../include/RedisPubSub.h"
+
+#include <algorithm>
+#include <memory>
+
+RedisPubSub& RedisPubSub::getInstance() {
+    static RedisPubSub instance;
+    return instance;
+}
+
+static void appendBulk(std::string& out, const std::string& s) {
+    out += "$" + std::to_string(s.size()) + "\r\n";
+    out += s;
+    out += "\r\n";
+}
+
+// *3\r\n$9\r\nsubscribe\r\n$<len>\r\n<channel>\r\n:<count>\r\n
+static std::string subscriptionReply(const char* kind, const std::string& name, size_t count) {
+    std::string out = "*3\r\n";
+    appendBulk(out, kind);
+    appendBulk(out, name);
+    out += ":" + std::to_string(count) + "\r\n";
+    return out;
+}
+
+static void removeSubscriber(std::vector<RedisClient*>& subscribers, RedisClient* client) {
+    auto it = std::find(subscribers.begin(), subscribers.end(), client);
+    if (it != subscribers.end()) {
+        // order of delivery between subscribers is not guaranteed, swap and pop
+        *it = subscribers.back();
+        subscribers.pop_back();
+    }
+}
+
+std::string RedisPubSub::subscribe(RedisClient& client, const std::vector<std::string>& channels) {
+    std::lock_guard<std::mutex> lock(pubsub_mutex);
+    std::string response;
+    for (const auto& channel : channels) {
+        if (client.channels.insert(channel).second) {
+            channel_subscribers[channel].push_back(&client);
+        }
+        response += subscriptionReply("subscribe", channel, client.subscriptionCount());
+    }
+    return response;
+}
+
+std::string RedisPubSub::unsubscribe(RedisClient& client, const std::vector<std::string>& channels) {
+    std::lock_guard<std::mutex> lock(pubsub_mutex);
+    // without arguments unsubscribe from every channel
+    std::vector<std::string> targets = channels;
+    if (targets.empty()) targets.assign(client.channels.begin(), client.channels.end());
+
+    std::string response;
+    if (targets.empty()) {
+        response += "*3\r\n$11\r\nunsubscribe\r\n$-1\r\n:" + std::to_string(client.subscriptionCount()) + "\r\n";
+        return response;
+    }
+    for (const auto& channel : targets) {
+        if (client.channels.erase(channel) > 0) {
+            auto it = channel_subscribers.find(channel);
+            if (it != channel_subscribers.end()) {
+                removeSubscriber(it->second, &client);
+                if (it->second.empty()) channel_subscribers.erase(it);
+            }
+        }
+        response += subscriptionReply("unsubscribe", channel, client.subscriptionCount());
+    }
+    return response;
+}
+
+std::string RedisPubSub::psubscribe(RedisClient& client, const std::vector<std::string>& patterns) {
+    std::lock_guard<std::mutex> lock(pubsub_mutex);
+    std::string response;
+    for (const auto& pattern : patterns) {
+        if (client.patterns.insert(pattern).second) {
+            pattern_subscribers[pattern].push_back(&client);
+        }
+        response += subscriptionReply("psubscribe", pattern, client.subscriptionCount());
+    }
+    return response;
+}
+
+std::string RedisPubSub::punsubscribe(RedisClient& client, const std::vector<std::string>& patterns) {
+    std::lock_guard<std::mutex> lock(pubsub_mutex);
+    std::vector<std::string> targets = patterns;
+    if (targets.empty()) targets.assign(client.patterns.begin(), client.patterns.end());
+
+    std::string response;
+    if (targets.empty()) {
+        response += "*3\r\n$12\r\npunsubscribe\r\n$-1\r\n:" + std::to_string(client.subscriptionCount()) + "\r\n";
+        return response;
+    }
+    for (const auto& pattern : targets) {
+        if (client.patterns.erase(pattern) > 0) {
+            auto it = pattern_subscribers.find(pattern);
+            if (it != pattern_subscribers.end()) {
+                removeSubscriber(it->second, &client);
+                if (it->second.empty()) pattern_subscribers.erase(it);
+            }
+        }
+        response += subscriptionReply("punsubscribe", pattern, client.subscriptionCount());
+    }
+    return response;
+}
+
+void RedisPubSub::removeClient(RedisClient& client) {
+    std::unique_lock<std::shared_mutex> alive(wake_mutex);
+    std::lock_guard<std::mutex> lock(pubsub_mutex);
+    for (const auto& channel : client.channels) {
+        auto it = channel_subscribers.find(channel);
+        if (it == channel_subscribers.end()) continue;
+        removeSubscriber(it->second, &client);
+        if (it->second.empty()) channel_subscribers.erase(it);
+    }
+    for (const auto& pattern : client.patterns) {
+        auto it = pattern_subscribers.find(pattern);
+        if (it == pattern_subscribers.end()) continue;
+        removeSubscriber(it->second, &client);
+        if (it->second.empty()) pattern_subscribers.erase(it);
+    }
+    client.channels.clear();
+    client.patterns.clear();
+}
+
+bool RedisPubSub::isSubscribed(RedisClient& client, const std::string& channel) {
+    std::lock_guard<std::mutex> lock(pubsub_mutex);
+    return client.channels.count(channel) > 0;
+}
+
+size_t RedisPubSub::publish(const std::string& channel, const std::string& message) {
+    std::shared_lock<std::shared_mutex> alive(wake_mutex);
+    std::unique_lock<std::mutex> lock(pubsub_mutex);
+    size_t receivers = 0;
+    // subscribers whose queue was empty; one eventfd write each, done after
+    // pubsub_mutex is released so SUBSCRIBE and other PUBLISHes don't wait on them
+    std::vector<RedisClient*> woken;
+    auto deliver = [&](RedisClient* client, const RedisReply& reply) {
+        bool needsWake;
+        if (!client->push(reply, needsWake)) return; // closing, or over its output limit
+        receivers++;
+        if (needsWake) woken.push_back(client);
+    };
+
+    // the message is encoded once and the same buffer goes to every subscriber
+    auto it = channel_subscribers.find(channel);
+    if (it != channel_subscribers.end() && !it->second.empty()) {
+        auto reply = std::make_shared<std::string>();
+        reply->reserve(32 + channel.size() + message.size());
+        *reply += "*3\r\n";
+        appendBulk(*reply, "message");
+        appendBulk(*reply, channel);
+        appendBulk(*reply, message);
+        RedisReply shared = std::move(reply);
+        for (RedisClient* client : it->second) deliver(client, shared);
+    }
+
+    // one pmessage buffer per matching pattern, shared by its subscribers
+    for (const auto& pattern : pattern_subscribers) {
+        if (pattern.second.empty() || !matchPattern(pattern.first, channel)) continue;
+        auto reply = std::make_shared<std::string>();
+        reply->reserve(48 + pattern.first.size() + channel.size() + message.size());
+        *reply += "*4\r\n";
+        appendBulk(*reply, "pmessage");
+        appendBulk(*reply, pattern.first);
+        appendBulk(*reply, channel);
+        appendBulk(*reply, message);
+        RedisReply shared = std::move(reply);
+        for (RedisClient* client : pattern.second) deliver(client, shared);
+    }
+    lock.unlock();
+    for (RedisClient* client : woken) client->wake();
+    return receivers;
+}
+
+bool RedisPubSub::matchPattern(const std::string& pattern, const std::string& str) {
+    size_t p = 0, s = 0;
+    // position to resume from when a '*' has to swallow one more character
+    size_t starP = std::string::npos, starS = 0;
+
+    while (s < str.size()) {
+        if (p < pattern.size()) {
+            char c = pattern[p];
+            if (c == '*') {
+                while (p < pattern.size() && pattern[p] == '*') p++;
+                if (p == pattern.size()) return true;
+                starP = p;
+                starS = s;
+                continue;
+            }
+            if (c == '?') {
+                p++;
+                s++;
+                continue;
+            }
+            if (c == '[') {
+                size_t q = p + 1;
+                bool negate = false;
+                if (q < pattern.size() && pattern[q] == '^') {
+                    negate = true;
+                    q++;
+                }
+                bool matched = false;
+                while (q < pattern.size() && pattern[q] != ']') {
+                    if (pattern[q] == '\\' && q + 1 < pattern.size()) {
+                        q++;
+                        if (pattern[q] == str[s]) matched = true;
+                    } else if (q + 2 < pattern.size() && pattern[q + 1] == '-' && pattern[q + 2] != ']') {
+                        char lo = pattern[q], hi = pattern[q + 2];
+                        if (lo > hi) std::swap(lo, hi);
+                        if (str[s] >= lo && str[s] <= hi) matched = true;
+                        q += 2;
+                    } else if (pattern[q] == str[s]) {
+                        matched = true;
+                    }
+                    q++;
+                }
+                if (negate) matched = !matched;
+                if (matched) {
+                    // an unterminated class behaves like the rest of the pattern was consumed
+                    p = q < pattern.size() ? q + 1 : q;
+                    s++;
+                    continue;
+                }
+            } else {
+                if (c == '\\' && p + 1 < pattern.size()) {
+                    p++;
+                    c = pattern[p];
+                }
+                if (c == str[s]) {
+                    p++;
+                    s++;
+                    continue;
+                }
+            }
+        }
+        // mismatch: backtrack to the last '*' if there is one
+        if (starP == std::string::npos) return false;
+        p = starP;
+        s = ++starS;
+    }
+    while (p < pattern.size() && pattern[p] == '*') p++;
+    return p == pattern.size();
+}
@@ -0,0 +1,162 @@
+#include "../include/RedisReadCache.h"
+#include "../include/RedisEpoch.h"
+
+#include <functional>
+
+RedisReadCache& RedisReadCache::getInstance() {
+    static RedisReadCache instance;
+    return instance;
+}
+
+RedisReadCache::RedisReadCache() {
+    setSlots(DEFAULT_SLOTS);
+}
+
+void RedisReadCache::setSlots(size_t count) {
+    clear();
+    size_t size = 0;
+    if (count > 0) {
+        size = WAYS;
+        while (size < count) size <<= 1;
+    }
+    set_count = size / WAYS;
+    sets.reset(set_count ? new Set[set_count] : nullptr);
+    for (size_t i = 0; i < set_count; i++) {
+        for (auto& way : sets[i].ways) way.store(nullptr, std::memory_order_relaxed);
+        sets[i].version.store(0, std::memory_order_relaxed);
+        for (auto& tag : sets[i].tags) tag.store(0, std::memory_order_relaxed);
+        for (auto& tag : sets[i].seen) tag.store(0, std::memory_order_relaxed);
+    }
+    set_mask = set_count ? set_count - 1 : 0;
+}
+
+size_t RedisReadCache::hashKey(const std::string& key) {
+    return std::hash<std::string>()(key);
+}
+
+static uint16_t wayTag(size_t hash) {
+    return static_cast<uint16_t>(hash >> (sizeof(size_t) * 8 - 16));
+}
+
+static size_t fieldHash(size_t keyHash, const std::string& field) {
+    size_t h = std::hash<std::string>()(field);
+    return keyHash ^ (h + 0x9e3779b97f4a7c15ULL + (keyHash << 6) + (keyHash >> 2));
+}
+
+bool RedisReadCache::matches(const Entry* entry, size_t hash, bool isField, const std::string& key,
+                             const std::string& field) const {
+    return entry->hash == hash && entry->is_field == isField && entry->key == key && (!isField || entry->field == field);
+}
+
+bool RedisReadCache::get(const std::string& key, size_t keyHash, std::string& value, bool& admit) {
+    return lookup(false, key, keyHash, std::string(), value, admit);
+}
+
+bool RedisReadCache::hget(const std::string& key, size_t keyHash, const std::string& field, std::string& value,
+                          bool& admit) {
+    return lookup(true, key, keyHash, field, value, admit);
+}
+
+bool RedisReadCache::lookup(bool isField, const std::string& key, size_t keyHash, const std::string& field,
+                            std::string& value, bool& admit) {
+    admit = false;
+    if (set_count == 0) return false;
+    size_t hash = isField ? fieldHash(keyHash, field) : keyHash;
+    Set& set = setOf(hash);
+    // tags are hints, stale ones only cost a miss or a look at the entries
+    uint16_t tag = wayTag(hash);
+    bool candidate = false;
+    for (auto& t : set.tags) candidate |= t.load(std::memory_order_relaxed) == tag;
+    if (candidate) {
+        RedisEpoch::Guard guard;
+        for (auto& way : set.ways) {
+            const Entry* entry = way.load(std::memory_order_acquire);
+            if (!entry || !matches(entry, hash, isField, key, field)) continue;
+            // read after the entry: a write that completed before it was loaded is seen
+            if (entry->version != setOf(keyHash).version.load(std::memory_order_acquire)) continue;
+            value = entry->value;
+            return true;
+        }
+    }
+    // admitted on the second miss: with a keyspace far bigger than the cache
+    // the mark is overwritten before a key comes back
+    uint32_t mark = static_cast<uint32_t>(hash >> (sizeof(size_t) * 4)) | 1;
+    std::atomic<uint32_t>& seen = set.seen[(mark >> 1) % WAYS];
+    if (seen.load(std::memory_order_relaxed) == mark) {
+        admit = true;
+    } else {
+        seen.store(mark, std::memory_order_relaxed);
+    }
+    return false;
+}
+
+uint64_t RedisReadCache::version(size_t keyHash) {
+    if (set_count == 0) return 0;
+    return setOf(keyHash).version.load(std::memory_order_relaxed);
+}
+
+void RedisReadCache::publish(const std::string& key, size_t keyHash, const std::string& value, uint64_t version) {
+    store(false, key, keyHash, std::string(), value, version);
+}
+
+void RedisReadCache::publish(const std::string& key, size_t keyHash, const std::string& field,
+                             const std::string& value, uint64_t version) {
+    store(true, key, keyHash, field, value, version);
+}
+
+void RedisReadCache::store(bool isField, const std::string& key, size_t keyHash, const std::string& field,
+                           const std::string& value, uint64_t version) {
+    if (set_count == 0 || value.size() > MAX_VALUE_SIZE) return;
+    size_t hash = isField ? fieldHash(keyHash, field) : keyHash;
+    Set& set = setOf(hash);
+    // the way of the same key, else an empty or stale one, else the next one in turn
+    thread_local size_t hand = 0;
+    size_t victim = WAYS;
+    Entry* old = nullptr;
+    {
+        RedisEpoch::Guard guard;
+        for (size_t i = 0; i < WAYS && victim == WAYS; i++) {
+            Entry* entry = set.ways[i].load(std::memory_order_acquire);
+            if (entry && matches(entry, hash, isField, key, field)) {
+                victim = i;
+                old = entry;
+            }
+        }
+        for (size_t i = 0; i < WAYS && victim == WAYS; i++) {
+            Entry* entry = set.ways[i].load(std::memory_order_acquire);
+            if (!entry || entry->version != setOf(entry->key_hash).version.load(std::memory_order_relaxed)) {
+                victim = i;
+                old = entry;
+            }
+        }
+    }
+    if (victim == WAYS) {
+        victim = hand++ % WAYS;
+        old = set.ways[victim].load(std::memory_order_relaxed);
+    }
+    Entry* entry = new Entry{hash, keyHash, version, isField, key, field, value};
+    set.tags[victim].store(wayTag(hash), std::memory_order_relaxed);
+    // a concurrent publish won the way; the cache is best effort
+    if (!set.ways[victim].compare_exchange_strong(old, entry, std::memory_order_acq_rel)) {
+        delete entry;
+        return;
+    }
+    if (old) RedisEpoch::getInstance().retire(old);
+}
+
+void RedisReadCache::invalidate(const std::string& key) {
+    if (set_count == 0) return;
+    // the entries of the key stay in place, stale, until a publish reuses their way
+    setOf(hashKey(key)).version.fetch_add(1, std::memory_order_release);
+}
+
+void RedisReadCache::clear() {
+    // also stales the values read before, whose publish may still be on its way
+    for (size_t i = 0; i < set_count; i++) {
+        sets[i].version.fetch_add(1, std::memory_order_release);
+        for (auto& way : sets[i].ways) {
+            Entry* old = way.exchange(nullptr, std::memory_order_acq_rel);
+            if (old) RedisEpoch::getInstance().retire(old);
+        }
+    }
+}
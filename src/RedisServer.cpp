@@ -1,10 +1,15 @@
 
 #include "../include/RedisServer.h"
 
+#include <cerrno>
 #include <csignal>
 #include <cstring>
 
+#include "../include/RedisClient.h"
 #include "../include/RedisCommandHandler.h"
+#include "../include/RedisPubSub.h"
+#include "../include/RedisTracking.h"
+#include "../include/RedisUringBackend.h"
 
 #include <iostream>
 #include <sys/socket.h>
@@ -12,10 +17,11 @@
 #include <thread>
 #include <vector>
 #include <netinet/in.h>
+#include <poll.h>
 
 #include "../include/RedisDatabase.h"
 
-static int REDIS_CONN_BACKLOG = 10;
+static int REDIS_CONN_BACKLOG = 511;
 static RedisServer* globalServer = nullptr;
 
 void signalHandler(int signum) {
@@ -30,7 +36,8 @@ void RedisServer::setupSignalHandler() {
     signal(SIGINT, signalHandler);
 }
 
-RedisServer::RedisServer(int port) : port(port), server_socket(-1), running(true) {
+RedisServer::RedisServer(int port, RedisIoBackend backend, const std::string& dbfilename)
+    : port(port), server_socket(-1), running(true), backend(backend), dbfilename(dbfilename) {
     globalServer = this;
     setupSignalHandler();
 };
@@ -61,14 +68,39 @@ void RedisServer::run() {
         return;
     }
 
-    if (listen(server_socket, REDIS_CONN_BACKLOG) < 0) { // backlog de conexoes = 10
+    if (listen(server_socket, REDIS_CONN_BACKLOG) < 0) { // backlog de conexoes = 511, igual ao tcp-backlog do redis
         perror("Error listening on server socket");
     }
 
-    std::cout << "Server started on port: " << port << std::endl;
+    RedisCommandHandler cmdHandler;
+    bool served = false;
+    if (backend == RedisIoBackend::Uring) {
+        RedisUringBackend uring(server_socket, cmdHandler, running);
+        std::string error;
+        if (uring.init(error)) {
+            std::cout << "Server started on port: " << port << " (io_uring)" << std::endl;
+            uring.run();
+            served = true;
+        } else {
+            std::cerr << "io_uring backend unavailable (" << error << "), using threads" << std::endl;
+        }
+    }
+    if (!served) {
+        std::cout << "Server started on port: " << port << std::endl;
+        runThreads(cmdHandler);
+    }
+
+    // shutdown
+    if (RedisDatabase::getInstance().dump(dbfilename)) {
+        std::cout << "Database dumped to " << dbfilename << std::endl;
+    } else {
+        std::cerr << "Error dumping database" << std::endl;
+    }
 
+}
+
+void RedisServer::runThreads(RedisCommandHandler& cmdHandler) {
     std::vector<std::thread> threads;
-    RedisCommandHandler cmdHandler;
 
     while (running) {
         int client_socket = accept(server_socket, nullptr, nullptr);
@@ -79,16 +111,36 @@ void RedisServer::run() {
             break;
         }
         threads.emplace_back([client_socket, &cmdHandler]() {
-            char buffer[1024];
-            while (true) {
-                memset(buffer, 0, sizeof(buffer));
-                int bytes = recv(client_socket, buffer, sizeof(buffer)-1, 0);
-                if (bytes <= 0) break;
-                std::string request(buffer, bytes);
-                std::string response = cmdHandler.processCommand(request);
-                send(client_socket, response.c_str(), response.size(), 0);
+            RedisClient client(client_socket);
+            RedisTracking::getInstance().addClient(client);
+            char buffer[16 * 1024];
+            while (!client.isClosing()) {
+                // wait for a request or for output queued by another thread (pub/sub)
+                pollfd fds[2];
+                fds[0].fd = client_socket;
+                fds[0].events = POLLIN | (client.hasPendingOutput() ? POLLOUT : 0);
+                fds[1].fd = client.wakeFd();
+                fds[1].events = POLLIN;
+                if (poll(fds, 2, -1) < 0) {
+                    if (errno == EINTR) continue;
+                    break;
+                }
+                if (fds[1].revents & POLLIN) {
+                    uint64_t wakeups;
+                    ssize_t ignored = read(client.wakeFd(), &wakeups, sizeof(wakeups));
+                    (void)ignored;
+                }
+                if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+                    int bytes = recv(client_socket, buffer, sizeof(buffer), 0);
+                    if (bytes <= 0) break;
+                    client.query_buffer.append(buffer, bytes);
+                    client.write(cmdHandler.processBuffer(client));
+                }
+                if (!client.flush()) break;
+                if (client.close_after_reply && !client.hasPendingOutput()) break;
             }
-            close(client_socket);
+            RedisPubSub::getInstance().removeClient(client);
+            RedisTracking::getInstance().removeClient(client);
 
         });
     }
@@ -96,12 +148,4 @@ void RedisServer::run() {
     for (auto& t : threads) {
         if (t.joinable()) t.join();
     }
-
-    // shutdown
-    if (RedisDatabase::getInstance().dump("dump.my_rdb")) {
-        std::cout << "Database dumped to dump.my_rdb" << std::endl;
-    } else {
-        std::cerr << "Error dumping database" << std::endl;
-    }
-
 }
\ No newline at end of file
@@ -0,0 +1,503 @@
+#include "../include/RedisSortedSet.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+// packed entry layout: [double score][uint32_t member length][member bytes]
+static const size_t PACKED_HEADER = sizeof(double) + sizeof(uint32_t);
+
+// (score, member) ordering used by both encodings
+static bool zslLess(double score1, const std::string& member1, double score2, const std::string& member2) {
+    return score1 < score2 || (score1 == score2 && member1 < member2);
+}
+
+RedisSortedSet::RedisSortedSet()
+    : packed_count(0), head(nullptr), tail(nullptr), levels(1), length(0) {}
+
+RedisSortedSet::~RedisSortedSet() {
+    slFree();
+}
+
+RedisSortedSet::RedisSortedSet(const RedisSortedSet& other) : RedisSortedSet() {
+    packed = other.packed;
+    packed_count = other.packed_count;
+    if (!other.isPacked()) {
+        convertToSkiplist();
+        for (Node* x = other.head->level[0].forward; x; x = x->level[0].forward) {
+            slInsert(x->member, x->score);
+        }
+        dict = other.dict;
+    }
+}
+
+RedisSortedSet::RedisSortedSet(RedisSortedSet&& other) noexcept
+    : packed(std::move(other.packed)), packed_count(other.packed_count), head(other.head),
+      tail(other.tail), levels(other.levels), length(other.length), dict(std::move(other.dict)) {
+    other.packed.clear();
+    other.packed_count = 0;
+    other.head = other.tail = nullptr;
+    other.levels = 1;
+    other.length = 0;
+}
+
+RedisSortedSet& RedisSortedSet::operator=(RedisSortedSet other) {
+    std::swap(packed, other.packed);
+    std::swap(packed_count, other.packed_count);
+    std::swap(head, other.head);
+    std::swap(tail, other.tail);
+    std::swap(levels, other.levels);
+    std::swap(length, other.length);
+    std::swap(dict, other.dict);
+    return *this;
+}
+
+size_t RedisSortedSet::size() const {
+    return isPacked() ? packed_count : length;
+}
+
+size_t RedisSortedSet::memoryUsage(size_t samples) const {
+    // heap part of a std::string, short ones are stored inline
+    auto heap = [](const std::string& s) { return s.capacity() > 15 ? s.capacity() + 1 : 0; };
+    size_t bytes = sizeof(RedisSortedSet) + heap(packed);
+    if (isPacked()) return bytes;
+    bytes += sizeof(Node) + head->level.capacity() * sizeof(Level) + dict.bucket_count() * sizeof(void*);
+    size_t measured = 0, measuredBytes = 0;
+    for (Node* node = head->level[0].forward; node && (samples == 0 || measured < samples);
+         node = node->level[0].forward) {
+        // skiplist node, plus the member -> score entry in dict (member copied)
+        measuredBytes += sizeof(Node) + node->level.capacity() * sizeof(Level) + heap(node->member);
+        measuredBytes += 2 * sizeof(void*) + sizeof(std::string) + sizeof(double) + heap(node->member);
+        measured++;
+    }
+    if (measured > 0) bytes += measuredBytes * length / measured;
+    return bytes;
+}
+
+/*
+ * Packed encoding
+ */
+std::vector<RedisSortedSet::PackedEntry> RedisSortedSet::unpack() const {
+    std::vector<PackedEntry> entries;
+    entries.reserve(packed_count);
+    size_t pos = 0;
+    while (pos < packed.size()) {
+        PackedEntry entry;
+        uint32_t len;
+        entry.offset = pos;
+        memcpy(&entry.score, packed.data() + pos, sizeof(double));
+        memcpy(&len, packed.data() + pos + sizeof(double), sizeof(uint32_t));
+        entry.member.assign(packed, pos + PACKED_HEADER, len);
+        pos += PACKED_HEADER + len;
+        entries.push_back(std::move(entry));
+    }
+    return entries;
+}
+
+bool RedisSortedSet::packedFind(const std::string& member, PackedEntry& entry) const {
+    size_t pos = 0;
+    while (pos < packed.size()) {
+        uint32_t len;
+        memcpy(&len, packed.data() + pos + sizeof(double), sizeof(uint32_t));
+        if (len == member.size() && packed.compare(pos + PACKED_HEADER, len, member) == 0) {
+            entry.offset = pos;
+            memcpy(&entry.score, packed.data() + pos, sizeof(double));
+            entry.member = member;
+            return true;
+        }
+        pos += PACKED_HEADER + len;
+    }
+    return false;
+}
+
+void RedisSortedSet::packedInsert(const std::string& member, double score) {
+    size_t pos = 0;
+    while (pos < packed.size()) {
+        double s;
+        uint32_t len;
+        memcpy(&s, packed.data() + pos, sizeof(double));
+        memcpy(&len, packed.data() + pos + sizeof(double), sizeof(uint32_t));
+        if (zslLess(score, member, s, packed.substr(pos + PACKED_HEADER, len))) break;
+        pos += PACKED_HEADER + len;
+    }
+    char header[PACKED_HEADER];
+    uint32_t len = member.size();
+    memcpy(header, &score, sizeof(double));
+    memcpy(header + sizeof(double), &len, sizeof(uint32_t));
+    packed.insert(pos, member);
+    packed.insert(pos, header, PACKED_HEADER);
+    packed_count++;
+}
+
+void RedisSortedSet::packedErase(const PackedEntry& entry) {
+    packed.erase(entry.offset, PACKED_HEADER + entry.member.size());
+    packed_count--;
+}
+
+void RedisSortedSet::convertToSkiplist() {
+    std::vector<PackedEntry> entries = unpack();
+    head = new Node{std::string(), 0, nullptr, std::vector<Level>(ZSKIPLIST_MAXLEVEL, Level{nullptr, 0})};
+    tail = nullptr;
+    levels = 1;
+    length = 0;
+    dict.reserve(entries.size());
+    for (const auto& entry : entries) {
+        slInsert(entry.member, entry.score);
+        dict[entry.member] = entry.score;
+    }
+    packed.clear();
+    packed.shrink_to_fit();
+    packed_count = 0;
+}
+
+/*
+ * Skiplist
+ */
+int RedisSortedSet::randomLevel() {
+    // p = 1/4, same as redis
+    static thread_local std::minstd_rand rng(std::random_device{}());
+    int level = 1;
+    while ((rng() & 0xFFFF) < (0xFFFF >> 2) && level < ZSKIPLIST_MAXLEVEL) level++;
+    return level;
+}
+
+RedisSortedSet::Node* RedisSortedSet::slInsert(const std::string& member, double score) {
+    Node* update[ZSKIPLIST_MAXLEVEL];
+    size_t rank[ZSKIPLIST_MAXLEVEL];
+    Node* x = head;
+    for (int i = levels - 1; i >= 0; i--) {
+        rank[i] = i == levels - 1 ? 0 : rank[i + 1];
+        while (x->level[i].forward && zslLess(x->level[i].forward->score, x->level[i].forward->member, score, member)) {
+            rank[i] += x->level[i].span;
+            x = x->level[i].forward;
+        }
+        update[i] = x;
+    }
+    int level = randomLevel();
+    if (level > levels) {
+        for (int i = levels; i < level; i++) {
+            rank[i] = 0;
+            update[i] = head;
+            update[i]->level[i].span = length;
+        }
+        levels = level;
+    }
+    x = new Node{member, score, nullptr, std::vector<Level>(level)};
+    for (int i = 0; i < level; i++) {
+        x->level[i].forward = update[i]->level[i].forward;
+        update[i]->level[i].forward = x;
+        x->level[i].span = update[i]->level[i].span - (rank[0] - rank[i]);
+        update[i]->level[i].span = (rank[0] - rank[i]) + 1;
+    }
+    // levels above the new node now skip one more element
+    for (int i = level; i < levels; i++) {
+        update[i]->level[i].span++;
+    }
+    x->backward = update[0] == head ? nullptr : update[0];
+    if (x->level[0].forward) {
+        x->level[0].forward->backward = x;
+    } else {
+        tail = x;
+    }
+    length++;
+    return x;
+}
+
+void RedisSortedSet::slDelete(const std::string& member, double score) {
+    Node* update[ZSKIPLIST_MAXLEVEL];
+    Node* x = head;
+    for (int i = levels - 1; i >= 0; i--) {
+        while (x->level[i].forward && zslLess(x->level[i].forward->score, x->level[i].forward->member, score, member)) {
+            x = x->level[i].forward;
+        }
+        update[i] = x;
+    }
+    x = x->level[0].forward;
+    if (!x || x->score != score || x->member != member) return;
+
+    for (int i = 0; i < levels; i++) {
+        if (update[i]->level[i].forward == x) {
+            update[i]->level[i].span += x->level[i].span - 1;
+            update[i]->level[i].forward = x->level[i].forward;
+        } else {
+            update[i]->level[i].span -= 1;
+        }
+    }
+    if (x->level[0].forward) {
+        x->level[0].forward->backward = x->backward;
+    } else {
+        tail = x->backward;
+    }
+    while (levels > 1 && head->level[levels - 1].forward == nullptr) levels--;
+    length--;
+    delete x;
+}
+
+RedisSortedSet::Node* RedisSortedSet::slNodeByRank(size_t rank) const {
+    size_t traversed = 0;
+    Node* x = head;
+    for (int i = levels - 1; i >= 0; i--) {
+        while (x->level[i].forward && traversed + x->level[i].span <= rank) {
+            traversed += x->level[i].span;
+            x = x->level[i].forward;
+        }
+        if (traversed == rank) return x;
+    }
+    return nullptr;
+}
+
+void RedisSortedSet::slFree() {
+    if (!head) return;
+    Node* x = head->level[0].forward;
+    while (x) {
+        Node* next = x->level[0].forward;
+        delete x;
+        x = next;
+    }
+    delete head;
+    head = tail = nullptr;
+    length = 0;
+    levels = 1;
+    dict.clear();
+}
+
+size_t RedisSortedSet::countWhile(const std::function<bool(double, const std::string&)>& pred) const {
+    size_t n = 0;
+    if (isPacked()) {
+        for (const auto& entry : unpack()) {
+            if (!pred(entry.score, entry.member)) break;
+            n++;
+        }
+        return n;
+    }
+    Node* x = head;
+    for (int i = levels - 1; i >= 0; i--) {
+        while (x->level[i].forward && pred(x->level[i].forward->score, x->level[i].forward->member)) {
+            n += x->level[i].span;
+            x = x->level[i].forward;
+        }
+    }
+    return n;
+}
+
+/*
+ * Public operations
+ */
+bool RedisSortedSet::add(const std::string& member, double score, int flags, ZAddResult& result, double& newScore) {
+    double current = 0;
+    bool exists = this->score(member, current);
+
+    if (!exists) {
+        if (flags & ZADD_XX) {
+            result = ZADD_NOP;
+            return true;
+        }
+        if (std::isnan(score)) return false;
+        if (isPacked()) {
+            packedInsert(member, score);
+            if (packed_count > ZSET_MAX_PACKED_ENTRIES || member.size() > ZSET_MAX_PACKED_VALUE) {
+                convertToSkiplist();
+            }
+        } else {
+            slInsert(member, score);
+            dict[member] = score;
+        }
+        newScore = score;
+        result = ZADD_ADDED;
+        return true;
+    }
+
+    newScore = current;
+    if (flags & ZADD_NX) {
+        result = ZADD_NOP;
+        return true;
+    }
+    double target = (flags & ZADD_INCR) ? current + score : score;
+    if (std::isnan(target)) return false;
+    if (((flags & ZADD_GT) && target <= current) || ((flags & ZADD_LT) && target >= current)) {
+        result = ZADD_NOP;
+        return true;
+    }
+    newScore = target;
+    if (target == current) {
+        result = ZADD_UNCHANGED;
+        return true;
+    }
+    if (isPacked()) {
+        PackedEntry entry;
+        packedFind(member, entry);
+        packedErase(entry);
+        packedInsert(member, target);
+    } else {
+        slDelete(member, current);
+        slInsert(member, target);
+        dict[member] = target;
+    }
+    result = ZADD_UPDATED;
+    return true;
+}
+
+bool RedisSortedSet::remove(const std::string& member) {
+    if (isPacked()) {
+        PackedEntry entry;
+        if (!packedFind(member, entry)) return false;
+        packedErase(entry);
+        return true;
+    }
+    auto it = dict.find(member);
+    if (it == dict.end()) return false;
+    slDelete(member, it->second);
+    dict.erase(it);
+    return true;
+}
+
+bool RedisSortedSet::score(const std::string& member, double& score) const {
+    if (isPacked()) {
+        PackedEntry entry;
+        if (!packedFind(member, entry)) return false;
+        score = entry.score;
+        return true;
+    }
+    auto it = dict.find(member);
+    if (it == dict.end()) return false;
+    score = it->second;
+    return true;
+}
+
+long RedisSortedSet::rank(const std::string& member, bool reverse) const {
+    double s;
+    if (!score(member, s)) return -1;
+    size_t before = countWhile([&](double score, const std::string& m) {
+        return zslLess(score, m, s, member);
+    });
+    return reverse ? static_cast<long>(size() - 1 - before) : static_cast<long>(before);
+}
+
+std::vector<std::pair<std::string, double>> RedisSortedSet::rangeByRank(size_t start, size_t stop, bool reverse) const {
+    std::vector<std::pair<std::string, double>> result;
+    size_t len = size();
+    if (start > stop || start >= len) return result;
+    if (stop >= len) stop = len - 1;
+    result.reserve(stop - start + 1);
+
+    if (isPacked()) {
+        std::vector<PackedEntry> entries = unpack();
+        for (size_t i = start; i <= stop; i++) {
+            const PackedEntry& entry = reverse ? entries[len - 1 - i] : entries[i];
+            result.emplace_back(entry.member, entry.score);
+        }
+        return result;
+    }
+
+    // jump to the first node in O(log n), then walk the bottom level
+    Node* x = slNodeByRank(reverse ? len - start : start + 1);
+    for (size_t i = start; x && i <= stop; i++) {
+        result.emplace_back(x->member, x->score);
+        x = reverse ? x->backward : x->level[0].forward;
+    }
+    return result;
+}
+
+std::vector<std::pair<std::string, double>> RedisSortedSet::rangeByBounds(size_t first, size_t end, bool reverse,
+                                                                          long offset, long limit) const {
+    if (end <= first || offset < 0 || limit == 0) return {};
+    size_t matching = end - first;
+    if (static_cast<size_t>(offset) >= matching) return {};
+    size_t n = matching - offset;
+    if (limit > 0 && static_cast<size_t>(limit) < n) n = limit;
+
+    if (reverse) {
+        size_t start = (size() - end) + offset;
+        return rangeByRank(start, start + n - 1, true);
+    }
+    size_t start = first + offset;
+    return rangeByRank(start, start + n - 1, false);
+}
+
+std::vector<std::pair<std::string, double>> RedisSortedSet::rangeByScore(const ZScoreRange& range, bool reverse,
+                                                                         long offset, long limit) const {
+    size_t first = countWhile([&](double score, const std::string&) {
+        return range.minex ? score <= range.min : score < range.min;
+    });
+    size_t end = countWhile([&](double score, const std::string&) {
+        return range.maxex ? score < range.max : score <= range.max;
+    });
+    return rangeByBounds(first, end, reverse, offset, limit);
+}
+
+std::vector<std::pair<std::string, double>> RedisSortedSet::rangeByLex(const ZLexRange& range, bool reverse,
+                                                                       long offset, long limit) const {
+    size_t first = countWhile([&](double, const std::string& member) {
+        if (range.mininf) return false;
+        return range.minex ? member <= range.min : member < range.min;
+    });
+    size_t end = countWhile([&](double, const std::string& member) {
+        if (range.maxinf) return true;
+        return range.maxex ? member < range.max : member <= range.max;
+    });
+    return rangeByBounds(first, end, reverse, offset, limit);
+}
+
+size_t RedisSortedSet::count(const ZScoreRange& range) const {
+    size_t first = countWhile([&](double score, const std::string&) {
+        return range.minex ? score <= range.min : score < range.min;
+    });
+    size_t end = countWhile([&](double score, const std::string&) {
+        return range.maxex ? score < range.max : score <= range.max;
+    });
+    return end > first ? end - first : 0;
+}
+
+bool RedisSortedSet::parseScore(const std::string& input, double& score) {
+    if (input.empty()) return false;
+    char* end = nullptr;
+    score = strtod(input.c_str(), &end);
+    return end && *end == '\0' && !std::isnan(score);
+}
+
+static bool parseScoreBound(const std::string& input, double& value, bool& exclusive) {
+    exclusive = !input.empty() && input[0] == '(';
+    return RedisSortedSet::parseScore(exclusive ? input.substr(1) : input, value);
+}
+
+bool RedisSortedSet::parseScoreRange(const std::string& min, const std::string& max, ZScoreRange& range) {
+    return parseScoreBound(min, range.min, range.minex) && parseScoreBound(max, range.max, range.maxex);
+}
+
+static bool parseLexBound(const std::string& input, std::string& value, bool& exclusive, bool& infinite, char infChar) {
+    infinite = false;
+    exclusive = false;
+    if (input.size() == 1 && input[0] == infChar) {
+        infinite = true;
+        return true;
+    }
+    if (input.empty() || (input[0] != '(' && input[0] != '[')) return false;
+    exclusive = input[0] == '(';
+    value = input.substr(1);
+    return true;
+}
+
+bool RedisSortedSet::parseLexRange(const std::string& min, const std::string& max, ZLexRange& range) {
+    // "+" as min or "-" as max match nothing, the same as an empty interval
+    if (min == "+" || max == "-") {
+        range.mininf = false;
+        range.maxinf = false;
+        range.min = "";
+        range.max = "";
+        range.minex = true;
+        range.maxex = true;
+        return true;
+    }
+    return parseLexBound(min, range.min, range.minex, range.mininf, '-') &&
+        parseLexBound(max, range.max, range.maxex, range.maxinf, '+');
+}
+
+std::string RedisSortedSet::formatScore(double score) {
+    if (std::isinf(score)) return score > 0 ? "inf" : "-inf";
+    char buf[64];
+    auto res = std::to_chars(buf, buf + sizeof(buf), score);
+    return std::string(buf, res.ptr);
+}
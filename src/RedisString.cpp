@@ -0,0 +1,73 @@
+#include "../include/RedisString.h"
+#include "../include/RedisCompression.h"
+
+RedisString::RedisString(const RedisString& other) : bytes(other.bytes), raw_size(other.raw_size) {
+    if (isCompressed()) RedisCompression::getInstance().account(1, bytes.size(), raw_size);
+}
+
+RedisString::RedisString(RedisString&& other) noexcept : bytes(std::move(other.bytes)), raw_size(other.raw_size) {
+    other.bytes.clear();
+    other.raw_size = 0;
+}
+
+RedisString& RedisString::operator=(RedisString other) noexcept {
+    // the old value leaves with other
+    bytes.swap(other.bytes);
+    std::swap(raw_size, other.raw_size);
+    return *this;
+}
+
+RedisString::~RedisString() {
+    if (isCompressed()) {
+        RedisCompression::getInstance().account(-1, -static_cast<long long>(bytes.size()),
+                                                -static_cast<long long>(raw_size));
+    }
+}
+
+std::string RedisString::value() const {
+    if (!isCompressed()) return bytes;
+    std::string plain;
+    RedisCompression::decompress(bytes.data(), bytes.size(), plain, raw_size);
+    return plain;
+}
+
+const std::string& RedisString::view(std::string& scratch) const {
+    if (!isCompressed()) return bytes;
+    RedisCompression::decompress(bytes.data(), bytes.size(), scratch, raw_size);
+    return scratch;
+}
+
+std::string& RedisString::raw() {
+    if (isCompressed()) {
+        std::string plain = value();
+        RedisCompression::getInstance().account(-1, -static_cast<long long>(bytes.size()),
+                                                -static_cast<long long>(raw_size));
+        bytes.swap(plain);
+        raw_size = 0;
+    }
+    return bytes;
+}
+
+bool RedisString::operator==(const std::string& other) const {
+    if (size() != other.size()) return false;
+    if (!isCompressed()) return bytes == other;
+    std::string scratch;
+    return view(scratch) == other;
+}
+
+void RedisString::compress() {
+    size_t threshold = RedisCompression::getInstance().threshold();
+    if (isCompressed() || threshold == 0 || bytes.size() < threshold || bytes.size() > UINT32_MAX) return;
+    // only worth it when at least 1/8 is saved
+    std::string packed;
+    if (!RedisCompression::compress(bytes.data(), bytes.size(), packed, bytes.size() - bytes.size() / 8)) return;
+    packed.shrink_to_fit();
+    raw_size = static_cast<uint32_t>(bytes.size());
+    bytes.swap(packed);
+    RedisCompression::getInstance().account(1, bytes.size(), raw_size);
+}
+
+size_t RedisString::allocated() const {
+    // short strings live inline
+    return bytes.capacity() > 15 ? bytes.capacity() + 1 : 0;
+}
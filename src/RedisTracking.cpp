@@ -0,0 +1,195 @@
+#include "../include/RedisTracking.h"
+#include "../include/RedisPubSub.h"
+
+#include <memory>
+
+RedisTracking& RedisTracking::getInstance() {
+    static RedisTracking instance;
+    return instance;
+}
+
+static void appendBulk(std::string& out, const std::string& s) {
+    out += "$" + std::to_string(s.size()) + "\r\n";
+    out += s;
+    out += "\r\n";
+}
+
+// RESP3: >2 invalidate [key] / >2 invalidate _ (flush)
+static RedisReply invalidatePush(const std::string* key) {
+    auto reply = std::make_shared<std::string>(">2\r\n$10\r\ninvalidate\r\n");
+    if (key) {
+        *reply += "*1\r\n";
+        appendBulk(*reply, *key);
+    } else {
+        *reply += "_\r\n";
+    }
+    return reply;
+}
+
+// RESP2: message __redis__:invalidate [key] / *-1 (flush)
+static RedisReply invalidateMessage(const std::string* key) {
+    auto reply = std::make_shared<std::string>("*3\r\n$7\r\nmessage\r\n$20\r\n__redis__:invalidate\r\n");
+    if (key) {
+        *reply += "*1\r\n";
+        appendBulk(*reply, *key);
+    } else {
+        *reply += "*-1\r\n";
+    }
+    return reply;
+}
+
+// RESP3: >2 tracking-redir-broken <redirect id>
+static RedisReply redirectBrokenPush(uint64_t redirect) {
+    auto reply = std::make_shared<std::string>(">2\r\n$21\r\ntracking-redir-broken\r\n");
+    *reply += ":" + std::to_string(redirect) + "\r\n";
+    return reply;
+}
+
+void RedisTracking::addClient(RedisClient& client) {
+    std::lock_guard<std::mutex> lock(tracking_mutex);
+    clients[client.id()] = &client;
+}
+
+void RedisTracking::removeClient(RedisClient& client) {
+    std::lock_guard<std::mutex> lock(tracking_mutex);
+    disableLocked(client);
+    // ids left in tracking_table are skipped when the key is invalidated
+    clients.erase(client.id());
+}
+
+RedisClient* RedisTracking::findClient(uint64_t id) {
+    std::lock_guard<std::mutex> lock(tracking_mutex);
+    auto it = clients.find(id);
+    return it == clients.end() ? nullptr : it->second;
+}
+
+std::string RedisTracking::enable(RedisClient& client, uint64_t redirect, bool bcast,
+                                  const std::vector<std::string>& prefixes) {
+    std::lock_guard<std::mutex> lock(tracking_mutex);
+    if (redirect != 0 && clients.find(redirect) == clients.end()) {
+        return "-ERR The client ID you want redirect to does not exist\r\n";
+    }
+    if (redirect == 0 && client.resp < 3) {
+        return "-ERR CLIENT TRACKING without REDIRECT needs RESP3, switch with HELLO 3\r\n";
+    }
+    if (!prefixes.empty() && !bcast) return "-ERR PREFIX option requires BCAST mode to be enabled\r\n";
+    if (client.tracking && client.tracking_bcast != bcast) {
+        return "-ERR You can't switch BCAST mode on/off before disabling tracking for this client\r\n";
+    }
+
+    if (!client.tracking) tracking_clients++;
+    client.tracking = true;
+    client.tracking_bcast = bcast;
+    client.tracking_redirect = redirect;
+    if (bcast) {
+        // no PREFIX: every key
+        std::vector<std::string> added = prefixes.empty() ? std::vector<std::string>{""} : prefixes;
+        for (const auto& prefix : added) {
+            if (client.tracking_prefixes.insert(prefix).second) prefix_table[prefix].insert(client.id());
+        }
+    }
+    return "+OK\r\n";
+}
+
+std::string RedisTracking::disable(RedisClient& client) {
+    std::lock_guard<std::mutex> lock(tracking_mutex);
+    disableLocked(client);
+    return "+OK\r\n";
+}
+
+void RedisTracking::disableLocked(RedisClient& client) {
+    if (!client.tracking) return;
+    for (const auto& prefix : client.tracking_prefixes) {
+        auto it = prefix_table.find(prefix);
+        if (it == prefix_table.end()) continue;
+        it->second.erase(client.id());
+        if (it->second.empty()) prefix_table.erase(it);
+    }
+    client.tracking_prefixes.clear();
+    client.tracking = false;
+    client.tracking_bcast = false;
+    client.tracking_redirect = 0;
+    tracking_clients--;
+}
+
+void RedisTracking::rememberKeys(RedisClient& client, const std::vector<std::string>& keys) {
+    std::lock_guard<std::mutex> lock(tracking_mutex);
+    if (!client.tracking || client.tracking_bcast) return;
+    for (const auto& key : keys) tracking_table[key].insert(client.id());
+
+    while (tracking_table.size() > max_keys) {
+        // the victim is whatever key sits first in the table; its clients are
+        // told to drop it, so they cannot keep serving it stale
+        auto victim = tracking_table.begin();
+        RedisReply push = invalidatePush(&victim->first);
+        RedisReply message = invalidateMessage(&victim->first);
+        for (uint64_t id : victim->second) deliver(id, push, message);
+        tracking_table.erase(victim);
+    }
+}
+
+void RedisTracking::deliver(uint64_t id, const RedisReply& push, const RedisReply& message) {
+    auto it = clients.find(id);
+    if (it == clients.end() || !it->second->tracking) return;
+    RedisClient* target = it->second;
+    if (target->tracking_redirect != 0) {
+        auto redirect = clients.find(target->tracking_redirect);
+        if (redirect == clients.end()) {
+            // as in Redis, only a RESP3 client can be told its target is gone
+            if (target->resp >= 3) target->push(redirectBrokenPush(target->tracking_redirect));
+            return;
+        }
+        target = redirect->second;
+    }
+    // a RESP2 connection reads the message only in pub/sub mode; anywhere
+    // else it would land in its stream of replies
+    if (target->resp < 3) {
+        if (!RedisPubSub::getInstance().isSubscribed(*target, "__redis__:invalidate")) return;
+        target->push(message);
+        return;
+    }
+    target->push(push);
+}
+
+void RedisTracking::invalidateKey(const std::string& key) {
+    if (tracking_clients == 0) return;
+    std::lock_guard<std::mutex> lock(tracking_mutex);
+    RedisReply push, message;
+
+    auto it = tracking_table.find(key);
+    if (it != tracking_table.end()) {
+        push = invalidatePush(&key);
+        message = invalidateMessage(&key);
+        for (uint64_t id : it->second) deliver(id, push, message);
+        tracking_table.erase(it);
+    }
+    for (const auto& entry : prefix_table) {
+        if (key.compare(0, entry.first.size(), entry.first) != 0) continue;
+        if (!push) {
+            push = invalidatePush(&key);
+            message = invalidateMessage(&key);
+        }
+        for (uint64_t id : entry.second) deliver(id, push, message);
+    }
+}
+
+void RedisTracking::invalidateAll() {
+    if (tracking_clients == 0) return;
+    std::lock_guard<std::mutex> lock(tracking_mutex);
+    RedisReply push = invalidatePush(nullptr);
+    RedisReply message = invalidateMessage(nullptr);
+    for (const auto& client : clients) {
+        if (client.second->tracking) deliver(client.first, push, message);
+    }
+    tracking_table.clear();
+}
+
+void RedisTracking::setMaxKeys(size_t maxKeys) {
+    std::lock_guard<std::mutex> lock(tracking_mutex);
+    max_keys = maxKeys;
+}
+
+size_t RedisTracking::trackedKeys() {
+    std::lock_guard<std::mutex> lock(tracking_mutex);
+    return tracking_table.size();
+}
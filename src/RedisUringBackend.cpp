@@ -0,0 +1,456 @@
+#include "../include/RedisUringBackend.h"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+
+#include "../include/RedisClient.h"
+#include "../include/RedisPubSub.h"
+#include "../include/RedisTracking.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifdef IORING_RECV_MULTISHOT
+
+static const unsigned URING_ENTRIES = 1024;
+// provided buffers for recv, the count must be a power of 2
+static const unsigned URING_BUF_COUNT = 1024;
+static const unsigned URING_BUF_SIZE = 16 * 1024;
+static const uint16_t URING_BUF_GROUP = 0;
+static const int URING_MAX_IOV = 64;
+
+// user_data = Connection pointer | operation (pointers are at least 8 aligned)
+enum UringOp : uint64_t {
+    OP_ACCEPT = 1,
+    OP_RECV = 2,
+    OP_SEND = 3,
+    OP_WAKE = 4,
+    OP_CANCEL = 5,
+    OP_PROBE = 6,
+};
+static const uint64_t OP_MASK = 7;
+
+struct RedisUringBackend::Connection {
+    explicit Connection(int fd) : client(fd) {}
+    RedisClient client;
+    bool recv_armed = false;
+    bool send_inflight = false;
+    bool closing = false;
+    bool pending = false; // already in pending_sends
+    iovec iov[URING_MAX_IOV];
+    msghdr msg{};
+};
+
+static int uringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+static int uringRegister(int fd, unsigned opcode, void* arg, unsigned args) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, args));
+}
+
+RedisUringBackend::RedisUringBackend(int listenFd, RedisCommandHandler& cmdHandler, std::atomic<bool>& running)
+    : listen_fd(listenFd), handler(cmdHandler), running(running), ring_fd(-1),
+      sq_ring(MAP_FAILED), sq_ring_size(0), sq_head(nullptr), sq_tail(nullptr), sq_mask(nullptr),
+      sq_array(nullptr), sq_entries(0), sq_local_tail(0), sqes(nullptr), sqes_size(0),
+      cq_head(nullptr), cq_tail(nullptr), cq_mask(nullptr), cqes(nullptr),
+      buf_ring(nullptr), buf_ring_size(0), buffers(nullptr), buf_local_tail(0), wake_fd(-1) {}
+
+RedisUringBackend::~RedisUringBackend() {
+    for (Connection* conn : connections) {
+        RedisPubSub::getInstance().removeClient(conn->client);
+        RedisTracking::getInstance().removeClient(conn->client);
+        delete conn;
+    }
+    if (ring_fd != -1) close(ring_fd);
+    if (sq_ring != MAP_FAILED) munmap(sq_ring, sq_ring_size);
+    if (sqes) munmap(sqes, sqes_size);
+    if (buf_ring) munmap(buf_ring, buf_ring_size);
+    delete[] buffers;
+    if (wake_fd != -1) close(wake_fd);
+}
+
+bool RedisUringBackend::init(std::string& error) {
+    io_uring_params params{};
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = URING_ENTRIES * 4;
+    ring_fd = uringSetup(URING_ENTRIES, &params);
+    if (ring_fd < 0) {
+        error = std::string("io_uring_setup: ") + strerror(errno);
+        return false;
+    }
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP)) {
+        error = "kernel io_uring is too old";
+        return false;
+    }
+
+    // sq and cq rings share one mapping
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    sq_ring_size = std::max(sqSize, cqSize);
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                   IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        error = std::string("mmap sq ring: ") + strerror(errno);
+        return false;
+    }
+    char* ring = static_cast<char*>(sq_ring);
+    sq_head = reinterpret_cast<unsigned*>(ring + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned*>(ring + params.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned*>(ring + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(ring + params.sq_off.array);
+    sq_entries = params.sq_entries;
+    sq_local_tail = *sq_tail;
+    cq_head = reinterpret_cast<unsigned*>(ring + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(ring + params.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned*>(ring + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(ring + params.cq_off.cqes);
+
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqeMap = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                        IORING_OFF_SQES);
+    if (sqeMap == MAP_FAILED) {
+        error = std::string("mmap sqes: ") + strerror(errno);
+        return false;
+    }
+    sqes = static_cast<io_uring_sqe*>(sqeMap);
+
+    // provided buffer ring (5.19+)
+    buf_ring_size = URING_BUF_COUNT * sizeof(io_uring_buf);
+    void* bufRingMap = mmap(nullptr, buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (bufRingMap == MAP_FAILED) {
+        error = std::string("mmap buffer ring: ") + strerror(errno);
+        return false;
+    }
+    buf_ring = static_cast<io_uring_buf_ring*>(bufRingMap);
+    io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring);
+    reg.ring_entries = URING_BUF_COUNT;
+    reg.bgid = URING_BUF_GROUP;
+    if (uringRegister(ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        error = std::string("provided buffer rings not supported: ") + strerror(errno);
+        return false;
+    }
+    buffers = new char[static_cast<size_t>(URING_BUF_COUNT) * URING_BUF_SIZE];
+    for (unsigned i = 0; i < URING_BUF_COUNT; i++) {
+        recycleBuffer(i);
+    }
+    __atomic_store_n(&buf_ring->tail, buf_local_tail, __ATOMIC_RELEASE);
+
+    if (!probeMultishotRecv()) {
+        error = "multishot recv not supported";
+        return false;
+    }
+
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0) {
+        error = std::string("eventfd: ") + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+// Multishot recv needs 6.0 and there is no feature bit for it: arm one on a
+// socketpair and look at the completion.
+bool RedisUringBackend::probeMultishotRecv() {
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0) return false;
+
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = pair[0];
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = OP_PROBE;
+    char byte = 'x';
+    if (write(pair[1], &byte, 1) != 1) {
+        close(pair[0]);
+        close(pair[1]);
+        return false;
+    }
+    submit(1);
+
+    bool supported = false;
+    unsigned head = *cq_head;
+    unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        io_uring_cqe* cqe = &cqes[head & *cq_mask];
+        if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_MORE)) supported = true;
+        if (cqe->flags & IORING_CQE_F_BUFFER) recycleBuffer(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+    // closing the peer ends the multishot recv; its final completion is
+    // skipped by the OP_PROBE case of the event loop
+    shutdown(pair[0], SHUT_RDWR);
+    close(pair[0]);
+    close(pair[1]);
+    __atomic_store_n(&buf_ring->tail, buf_local_tail, __ATOMIC_RELEASE);
+    return supported;
+}
+
+io_uring_sqe* RedisUringBackend::getSqe() {
+    // ring full: hand what we have to the kernel first
+    if (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+        submit(0);
+    }
+    unsigned index = sq_local_tail & *sq_mask;
+    sq_array[index] = index;
+    io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_local_tail++;
+    return sqe;
+}
+
+int RedisUringBackend::submit(unsigned waitFor) {
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+    unsigned toSubmit = sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    if (toSubmit == 0 && waitFor == 0) return 0;
+    int ret;
+    do {
+        ret = uringEnter(ring_fd, toSubmit, waitFor, waitFor ? IORING_ENTER_GETEVENTS : 0);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+void RedisUringBackend::recycleBuffer(uint16_t bid) {
+    // not buf_ring->bufs: in C++ the empty struct of __DECLARE_FLEX_ARRAY takes
+    // a byte and shifts the array, the kernel expects it at offset 0
+    io_uring_buf* buf = reinterpret_cast<io_uring_buf*>(buf_ring) + (buf_local_tail & (URING_BUF_COUNT - 1));
+    buf->addr = reinterpret_cast<uint64_t>(buffers + static_cast<size_t>(bid) * URING_BUF_SIZE);
+    buf->len = URING_BUF_SIZE;
+    buf->bid = bid;
+    buf_local_tail++;
+}
+
+void RedisUringBackend::armAccept() {
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = OP_ACCEPT;
+}
+
+void RedisUringBackend::armRecv(Connection* conn) {
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->client.fd();
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = reinterpret_cast<uint64_t>(conn) | OP_RECV;
+    conn->recv_armed = true;
+}
+
+void RedisUringBackend::armWake() {
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = wake_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = OP_WAKE;
+}
+
+void RedisUringBackend::scheduleSend(Connection* conn) {
+    if (conn->send_inflight || conn->closing) return;
+    int count = conn->client.prepareOutput(conn->iov, URING_MAX_IOV);
+    if (count == 0) return;
+    conn->msg = msghdr{};
+    conn->msg.msg_iov = conn->iov;
+    conn->msg.msg_iovlen = count;
+
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = conn->client.fd();
+    sqe->addr = reinterpret_cast<uint64_t>(&conn->msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = reinterpret_cast<uint64_t>(conn) | OP_SEND;
+    conn->send_inflight = true;
+}
+
+void RedisUringBackend::startClose(Connection* conn) {
+    if (conn->closing) {
+        maybeDestroy(conn);
+        return;
+    }
+    conn->closing = true;
+    // shutdown makes the multishot recv complete with 0, a pending send fails
+    conn->client.close();
+    if (conn->recv_armed) {
+        io_uring_sqe* sqe = getSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = reinterpret_cast<uint64_t>(conn) | OP_RECV;
+        sqe->user_data = OP_CANCEL;
+    }
+    maybeDestroy(conn);
+}
+
+void RedisUringBackend::maybeDestroy(Connection* conn) {
+    if (!conn->closing || conn->recv_armed || conn->send_inflight) return;
+    RedisPubSub::getInstance().removeClient(conn->client);
+    RedisTracking::getInstance().removeClient(conn->client);
+    if (conn->pending) {
+        pending_sends.erase(std::remove(pending_sends.begin(), pending_sends.end(), conn), pending_sends.end());
+    }
+    {
+        std::lock_guard<std::mutex> lock(remote_mutex);
+        remote_pending.erase(std::remove(remote_pending.begin(), remote_pending.end(), conn), remote_pending.end());
+    }
+    connections.erase(conn);
+    delete conn;
+}
+
+void RedisUringBackend::handleAccept(int res, uint32_t flags) {
+    if (res >= 0) {
+        Connection* conn = new Connection(res);
+        connections.insert(conn);
+        RedisTracking::getInstance().addClient(conn->client);
+        conn->client.onPendingOutput = [this, conn](RedisClient&) {
+            if (std::this_thread::get_id() == loop_thread) {
+                if (!conn->pending) {
+                    conn->pending = true;
+                    pending_sends.push_back(conn);
+                }
+                return;
+            }
+            std::lock_guard<std::mutex> lock(remote_mutex);
+            remote_pending.push_back(conn);
+            uint64_t one = 1;
+            ssize_t ignored = ::write(wake_fd, &one, sizeof(one));
+            (void)ignored;
+        };
+        armRecv(conn);
+    } else if (running) {
+        std::cerr << "Error accepting client connection: " << strerror(-res) << std::endl;
+    }
+    if (!(flags & IORING_CQE_F_MORE) && running) armAccept();
+}
+
+void RedisUringBackend::handleRecv(Connection* conn, int res, uint32_t flags) {
+    if (!(flags & IORING_CQE_F_MORE)) conn->recv_armed = false;
+    if (res > 0 && (flags & IORING_CQE_F_BUFFER)) {
+        uint16_t bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        if (!conn->closing && !conn->client.close_after_reply) {
+            conn->client.query_buffer.append(buffers + static_cast<size_t>(bid) * URING_BUF_SIZE, res);
+            conn->client.write(handler.processBuffer(conn->client));
+            if (!conn->pending) {
+                conn->pending = true;
+                pending_sends.push_back(conn);
+            }
+        }
+        recycleBuffer(bid);
+    }
+    if (conn->client.isClosing() || res == 0 || (res < 0 && res != -ENOBUFS)) {
+        startClose(conn);
+        return;
+    }
+    // multishot ends when the buffer ring ran dry; the buffers come back at
+    // the end of this iteration, so it is safe to re-arm right away
+    if (!conn->recv_armed && !conn->closing) armRecv(conn);
+}
+
+void RedisUringBackend::handleSend(Connection* conn, int res) {
+    conn->send_inflight = false;
+    if (res < 0 || conn->closing) {
+        startClose(conn);
+        return;
+    }
+    conn->client.consumeOutput(res);
+    if (conn->client.hasPendingOutput()) {
+        scheduleSend(conn);
+    } else if (conn->client.close_after_reply) {
+        startClose(conn);
+    }
+}
+
+void RedisUringBackend::handleWake(uint32_t flags) {
+    uint64_t wakeups;
+    ssize_t ignored = read(wake_fd, &wakeups, sizeof(wakeups));
+    (void)ignored;
+    std::vector<Connection*> remote;
+    {
+        std::lock_guard<std::mutex> lock(remote_mutex);
+        remote.swap(remote_pending);
+    }
+    for (Connection* conn : remote) {
+        if (!conn->pending) {
+            conn->pending = true;
+            pending_sends.push_back(conn);
+        }
+    }
+    if (!(flags & IORING_CQE_F_MORE)) armWake();
+}
+
+void RedisUringBackend::run() {
+    loop_thread = std::this_thread::get_id();
+    armAccept();
+    armWake();
+
+    while (running) {
+        // replies produced by the last batch go out with this same enter
+        for (Connection* conn : pending_sends) {
+            conn->pending = false;
+            scheduleSend(conn);
+        }
+        pending_sends.clear();
+        __atomic_store_n(&buf_ring->tail, buf_local_tail, __ATOMIC_RELEASE);
+
+        if (submit(1) < 0 && errno != EBUSY) {
+            perror("io_uring_enter");
+            break;
+        }
+
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            io_uring_cqe cqe = cqes[head & *cq_mask];
+            // release the slot right away, handlers may queue new SQEs
+            __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+            Connection* conn = reinterpret_cast<Connection*>(cqe.user_data & ~OP_MASK);
+            switch (cqe.user_data & OP_MASK) {
+                case OP_ACCEPT: handleAccept(cqe.res, cqe.flags); break;
+                case OP_RECV: handleRecv(conn, cqe.res, cqe.flags); break;
+                case OP_SEND: handleSend(conn, cqe.res); break;
+                case OP_WAKE: handleWake(cqe.flags); break;
+                case OP_PROBE:
+                    if (cqe.flags & IORING_CQE_F_BUFFER) recycleBuffer(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                    break;
+                default: break;
+            }
+        }
+    }
+}
+
+#else // no multishot recv in the kernel headers
+
+struct RedisUringBackend::Connection {};
+
+RedisUringBackend::RedisUringBackend(int listenFd, RedisCommandHandler& cmdHandler, std::atomic<bool>& running)
+    : listen_fd(listenFd), handler(cmdHandler), running(running), ring_fd(-1) {}
+
+RedisUringBackend::~RedisUringBackend() {}
+
+bool RedisUringBackend::init(std::string& error) {
+    error = "built without io_uring support";
+    return false;
+}
+
+void RedisUringBackend::run() {}
+
+#endif
@@ -1,29 +1,81 @@
 #include <iostream>
 #include <thread>
+#include "../include/RedisCluster.h"
+#include "../include/RedisCompression.h"
+#include "../include/RedisReadCache.h"
 #include "../include/RedisServer.h"
+#include "../include/RedisTracking.h"
 #include "../include/RedisDatabase.h"
 
 int main(int argc, char* argv[]) {
     int port = 6371;
-    if (argc >=2) port = std::stoi(argv[1]);
-    if (RedisDatabase::getInstance().load("dump.my_rdb")) {
-        std::cout << "Database loaded from dump.my_rdb" << std::endl;
+    RedisIoBackend backend = RedisIoBackend::Threads;
+    bool clusterEnabled = false;
+    std::string announceIp = "127.0.0.1";
+    std::string dbfilename;
+    // usage: redis_server [port] [--io-backend=threads|uring] [--cluster-enabled] [--cluster-announce-ip=<ip>]
+    //                    [--tracking-table-max-keys=<n>] [--value-compression-threshold=<bytes>]
+    //                    [--read-cache-slots=<n>] [--dbfilename=<file>]
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--tracking-table-max-keys=", 0) == 0) {
+            RedisTracking::getInstance().setMaxKeys(std::stoull(arg.substr(arg.find('=') + 1)));
+        } else if (arg.rfind("--value-compression-threshold=", 0) == 0) {
+            RedisCompression::getInstance().setThreshold(std::stoull(arg.substr(arg.find('=') + 1)));
+        } else if (arg.rfind("--read-cache-slots=", 0) == 0) {
+            RedisReadCache::getInstance().setSlots(std::stoull(arg.substr(arg.find('=') + 1)));
+        } else if (arg.rfind("--dbfilename=", 0) == 0) {
+            dbfilename = arg.substr(arg.find('=') + 1);
+        } else if (arg == "--cluster-enabled") {
+            clusterEnabled = true;
+        } else if (arg.rfind("--cluster-announce-ip=", 0) == 0) {
+            announceIp = arg.substr(arg.find('=') + 1);
+        } else if (arg == "--io-backend=uring") {
+            backend = RedisIoBackend::Uring;
+        } else if (arg == "--io-backend=threads") {
+            backend = RedisIoBackend::Threads;
+        } else if (arg.rfind("--", 0) == 0) {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return 1;
+        } else {
+            port = std::stoi(arg);
+        }
+    }
+    // cluster nodes usually share a directory; each keeps its own snapshot
+    if (dbfilename.empty()) {
+        dbfilename = clusterEnabled ? "dump-" + std::to_string(port) + ".my_rdb" : "dump.my_rdb";
+    }
+    // before load, so the load workers fill the slot index
+    if (clusterEnabled) RedisDatabase::getInstance().enableSlotIndex();
+    if (RedisDatabase::getInstance().load(dbfilename)) {
+        std::cout << "Database loaded from " << dbfilename << std::endl;
     }
-    RedisServer server(port);
+    if (clusterEnabled) RedisCluster::getInstance().enable(port, announceIp);
+    RedisServer server(port, backend, dbfilename);
 
     // Background persistance: dump the database every 300 seconds
-    std::thread persistanceThread([]() { // construtor com callable com argumentos
+    std::thread persistanceThread([dbfilename]() { // construtor com callable com argumentos
         while  (true) {
             std::this_thread::sleep_for(std::chrono::seconds(300)); // anotar std::this_thread
-            if (!RedisDatabase::getInstance().dump("dump.my_rdb")) {
+            if (!RedisDatabase::getInstance().dump(dbfilename)) {
                 std::cerr << "Error dumping database" << std::endl;
             }else {
-                std::cout << "Database dumped to dump.my_rdb" << std::endl;
+                std::cout << "Database dumped to " << dbfilename << std::endl;
             }
         }
     }); // anotar tambem esse cara no resumo do namespace std.
     persistanceThread.detach(); // o que isso faz eh a thread ser 'desvinculada' do objeto
     // persistenceThread e passa a rodar sozinha em background independente do lifecycle de persistenceThread.
+
+    // Active expiry: delete expired keys every 100ms, without sleeping while batches keep finding some
+    std::thread expireThread([]() {
+        while (true) {
+            if (RedisDatabase::getInstance().activeExpireCycle() == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+        }
+    });
+    expireThread.detach();
     server.run();
 
     return 0;